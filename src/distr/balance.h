@@ -0,0 +1,131 @@
+// Created by Petr Karnakov on 15.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <istream>
+#include <numeric>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "geom/idx.h"
+#include "util/logger.h"
+
+// Partitioning of blocks between ranks based on measured cost.
+namespace balance {
+
+// Returns position of block `w` along the Morton (Z-order) curve.
+template <size_t dim>
+uint64_t GetMortonIndex(generic::MIdx<dim> w) {
+  const size_t nbits = 64 / dim;
+  uint64_t res = 0;
+  for (size_t bit = 0; bit < nbits; ++bit) {
+    for (size_t d = 0; d < dim; ++d) {
+      res |= uint64_t((w[d] >> bit) & 1) << (bit * dim + d);
+    }
+  }
+  return res;
+}
+
+// Returns indices of blocks sorted along the Morton curve.
+template <size_t dim>
+std::vector<size_t> GetMortonOrder(const std::vector<generic::MIdx<dim>>& ww) {
+  std::vector<uint64_t> key(ww.size());
+  for (size_t i = 0; i < ww.size(); ++i) {
+    key[i] = GetMortonIndex<dim>(ww[i]);
+  }
+  std::vector<size_t> order(ww.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::stable_sort(order.begin(), order.end(), [&key](size_t a, size_t b) {
+    return key[a] < key[b];
+  });
+  return order;
+}
+
+// Splits blocks into `nparts` contiguous parts along `order`
+// with approximately equal total cost.
+// cost: cost of each block
+// order: indices of blocks in the order of traversal
+// Returns part of each block.
+inline std::vector<int> Partition(
+    const std::vector<double>& cost, const std::vector<size_t>& order,
+    int nparts) {
+  const double total = std::accumulate(cost.begin(), cost.end(), 0.);
+  std::vector<int> part(cost.size(), 0);
+  double sum = 0; // total cost of blocks before current
+  for (size_t i = 0; i < order.size(); ++i) {
+    const size_t b = order[i];
+    const double mid = sum + cost[b] * 0.5;
+    // uniform partition along the curve if all costs are zero
+    const double frac = (total > 0 ? mid / total : (i + 0.5) / order.size());
+    part[b] = std::min(nparts - 1, int(frac * nparts));
+    sum += cost[b];
+  }
+  return part;
+}
+
+// Returns ratio of the maximum to the mean total cost over parts.
+inline double GetImbalance(
+    const std::vector<double>& cost, const std::vector<int>& part,
+    int nparts) {
+  std::vector<double> sum(nparts, 0);
+  for (size_t b = 0; b < cost.size(); ++b) {
+    sum[part[b]] += cost[b];
+  }
+  const double max = *std::max_element(sum.begin(), sum.end());
+  const double mean = std::accumulate(sum.begin(), sum.end(), 0.) / nparts;
+  return mean > 0 ? max / mean : 1;
+}
+
+// Reads partition in CSV format written by DistrMesh::ReportBalance()
+// with block index in columns x,y,z and part in column `partition`.
+// Returns block index and part for each row.
+template <size_t dim>
+std::vector<std::pair<generic::MIdx<dim>, int>> ReadPartition(
+    std::istream& in) {
+  auto split = [](const std::string& line) {
+    std::vector<std::string> res;
+    std::stringstream ss(line);
+    std::string s;
+    while (std::getline(ss, s, ',')) {
+      res.push_back(s);
+    }
+    return res;
+  };
+  std::string line;
+  fassert(std::getline(in, line), "ReadPartition: missing header");
+  const auto header = split(line);
+  auto find = [&header](const std::string& name) {
+    const auto it = std::find(header.begin(), header.end(), name);
+    fassert(it != header.end(), "ReadPartition: missing column '" + name + "'");
+    return size_t(it - header.begin());
+  };
+  const std::string xyz = "xyzw";
+  std::array<size_t, dim> column_w;
+  for (size_t d = 0; d < dim; ++d) {
+    column_w[d] = find(std::string(1, xyz[d]));
+  }
+  const size_t column_part = find("partition");
+
+  std::vector<std::pair<generic::MIdx<dim>, int>> res;
+  while (std::getline(in, line)) {
+    if (line.empty()) {
+      continue;
+    }
+    const auto row = split(line);
+    fassert_equal(row.size(), header.size(), ", line '" + line + "'");
+    generic::MIdx<dim> w;
+    for (size_t d = 0; d < dim; ++d) {
+      w[d] = std::stoi(row[column_w[d]]);
+    }
+    res.emplace_back(w, std::stoi(row[column_part]));
+  }
+  return res;
+}
+
+} // namespace balance
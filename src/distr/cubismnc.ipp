@@ -675,6 +675,7 @@ void Cubismnc<Par, M>::Scatter(const std::vector<size_t>& bb) {
 template <class Par, class M>
 void Cubismnc<Par, M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
   using OpScal = typename UReduce<Scal>::OpS;
+  using OpSumV = typename UReduce<Scal>::OpSumV;
   using OpScalInt = typename UReduce<Scal>::OpSI;
   using OpConcat = typename UReduce<Scal>::OpCat;
 
@@ -713,6 +714,27 @@ void Cubismnc<Par, M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
     }
     return;
   }
+  if (auto* first = dynamic_cast<OpSumV*>(firstbase)) {
+    auto buf = first->Neutral(); // result
+
+    // Reduce over blocks on current rank
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Append(buf);
+    }
+
+    MPI_Datatype mt = (sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT);
+
+    // Reduce over ranks
+    MPI_Allreduce(MPI_IN_PLACE, buf.data(), buf.size(), mt, MPI_SUM, comm_);
+
+    // Write results to all blocks on current rank
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Set(buf);
+    }
+    return;
+  }
   if (auto* first = dynamic_cast<OpScalInt*>(firstbase)) {
     auto buf = first->Neutral(); // result
 
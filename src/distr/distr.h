@@ -5,6 +5,7 @@
 
 #include <array>
 #include <iomanip>
+#include <list>
 #include <map>
 #include <memory>
 #include <sstream>
@@ -21,6 +22,7 @@
 #include "util/mpi.h"
 #include "util/suspender.h"
 #include "util/sysinfo.h"
+#include "util/trace.h"
 
 // Abstract block processor aware of Mesh.
 template <class M_>
@@ -65,6 +67,7 @@ class DistrMesh {
   bool isroot_ = false; // XXX: overwritten by derived classes
   std::vector<std::unique_ptr<KernelMesh<M>>> kernels_;
   std::unique_ptr<M> mshared_;
+  std::unique_ptr<EventTrace> trace_; // timeline of events, null if disabled
 
   DistrMesh(MPI_Comm comm, const KernelMeshFactory<M>& kf, Vars& var);
   // Performs communication and returns indices of blocks with updated halos.
@@ -75,10 +78,27 @@ class DistrMesh {
     bbi.insert(bbi.end(), bbh.begin(), bbh.end());
     return bbi;
   }
+  // Returns indices of blocks that have received their halos from
+  // communication started by TransferHalos(true), so that they can run
+  // before the communication is finished. Called repeatedly until returns
+  // an empty list, the remaining blocks are returned by TransferHalos(false).
+  virtual std::vector<size_t> TransferHalosNext() {
+    return {};
+  }
   // Fill selected halo cells with garbage
   void ApplyNanFaces(const std::vector<size_t>& bb);
   // Call kernels for current stage
   virtual void RunKernels(const std::vector<size_t>& bb);
+  // Calls kernels with work stealing. Each thread starts with the blocks
+  // it ran last time and takes blocks from other threads when idle.
+  void RunKernelsSteal(const std::vector<size_t>& bb);
+  // Calls kernels on fixed threads. Each block runs on the same thread
+  // in all stages, so its fields are first touched and later accessed
+  // by one thread and stay on the NUMA node of that thread.
+  void RunKernelsFixed(const std::vector<size_t>& bb);
+  // Pins each OpenMP thread to one CPU from the affinity mask
+  // of the process
+  void PinThreads();
   // Performs reduction with a single request over all blocks.
   // block_request: request for each block, same dimension as `kernels_`
   virtual void ReduceSingleRequest(const std::vector<RedOp*>& blocks) = 0;
@@ -86,6 +106,11 @@ class DistrMesh {
   // Performs reduction with all requests collected in m.GetReduce()
   // for all elements in `kernels_`
   virtual void Reduce(const std::vector<size_t>& bb);
+  // Starts reductions requested by m.ReduceDeferred() and completes
+  // all deferred reductions if requested by m.WaitReduce()
+  virtual void ReduceDeferred(const std::vector<size_t>& bb);
+  // Waits for deferred reductions and writes results to blocks
+  void WaitReduceDeferred();
   virtual void ReduceToLead(const std::vector<size_t>& bb);
   virtual void ReduceShared(const std::vector<size_t>& bb);
   virtual void Scatter(const std::vector<size_t>& bb) = 0;
@@ -106,10 +131,69 @@ class DistrMesh {
   virtual void MakeKernels(const std::vector<BlockInfoProxy>&);
   virtual void TimerReport(const std::vector<size_t>& bb);
   virtual void ClearTimerReport(const std::vector<size_t>& bb);
+  // Returns object recording event `name` on current thread
+  // until destruction if tracing is enabled
+  EventTrace::Scope TraceScope(const char* name);
+  // Writes events recorded in trace_ to trace_<rank>.json
+  // and trace_<rank>.folded depending on `trace_format`.
+  void WriteTrace();
+  // Runs kernel of block b and, if perf_counters is enabled, adds
+  // hardware counters of the calling thread to thread_counters_
+  void RunKernel(size_t b);
+  // Adds time of blocks in current stage to block_cost_ and imbalance_
+  void CollectBlockTime(const std::string& stage);
+  // Writes compute time of each stage over ranks to <path>_imbalance.csv
+  // and stages with the highest ratio max/mean over ranks together
+  // with the slowest blocks to <path>_imbalance.json, then resets the time.
+  // path: path to timer report, extension is removed
+  // Collective over comm_.
+  void ReportImbalance(const std::string& path);
+  // Writes measured cost of blocks and their partition between ranks
+  // along the Morton curve to balance.csv, prints the imbalance.
+  // The partition is applied by Native on restart with balance_partition.
+  // Collective over comm_.
+  void ReportBalance();
 
  private:
   MultiTimer<std::string> multitimer_all_;
   MultiTimer<std::string> multitimer_report_;
+  // Counters of the main thread to check availability,
+  // null if perf_counters is disabled
+  std::unique_ptr<PerfCounters> perf_;
+  // Counters of kernels run by each thread in current stage
+  std::vector<PerfCounters::Values> thread_counters_;
+  // Work stealing in RunKernels()
+  struct ThreadStat {
+    double busy = 0; // time in kernels
+    double idle = 0; // time waiting for other threads
+    size_t blocks = 0; // number of blocks
+    size_t steals = 0; // number of blocks taken from other threads
+  };
+  bool steal_;
+  bool numa_; // run blocks on fixed threads with RunKernelsFixed()
+  std::vector<int> block_thread_; // thread that last ran each block, or -1
+  std::vector<ThreadStat> thread_stat_; // statistics for each thread
+  // Deferred reduction in progress, may combine multiple requests
+  struct DeferredReduce {
+    // for each combined request, request from each block
+    std::vector<std::vector<std::unique_ptr<RedOp>>> blocks;
+    std::vector<Scal> values; // results for UReduce::OpS
+    std::pair<Scal, int> value_loc; // result for UReduce::OpSI
+#if USEFLAG(MPI)
+    MPI_Request request;
+#endif
+  };
+  std::list<DeferredReduce> deferred_;
+  bool balance_report_; // measure cost of blocks for ReportBalance()
+  std::vector<double> block_cost_; // time in kernels for each block
+  bool imbalance_report_; // measure time of stages for ReportImbalance()
+  std::vector<double> block_time_; // time of each block in current stage
+  double compute_time_ = 0; // time in RunKernels() in current stage
+  struct StageTime {
+    double compute = 0; // time in RunKernels() on current rank
+    std::vector<double> blocks; // time of each block
+  };
+  std::map<std::string, StageTime> imbalance_; // time of each stage
 };
 
 template <class M>
@@ -4,18 +4,34 @@
 #ifdef _OPENMP
 #include <omp.h>
 #endif
+#ifdef __linux__
+#include <sched.h>
+#endif
 
+#include <algorithm>
+#include <deque>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <stdexcept>
 
+#include "balance.h"
 #include "distr.h"
 #include "dump/raw.h"
 #include "dump/xmf.h"
 #include "reduce.h"
 #include "report.h"
+#include "util/bufferpool.h"
 #include "util/filesystem.h"
 #include "util/format.h"
+#include "util/memtrack.h"
+#include "util/timer.h"
+#include "util/topology.h"
+#if USEFLAG(MPI)
+#include "util/subcomm.h"
+#endif
 
 template <class M>
 M DistrMesh<M>::CreateSharedMesh(
@@ -80,16 +96,319 @@ DistrMesh<M>::DistrMesh(
     , domain_(
           var.Int["hl"], GetMIdx<dim>(var.Int, "bs"),
           GetMIdx<dim>(var.Int, "p"), GetMIdx<dim>(var.Int, "b"),
-          var.Double["extent"]) {}
+          var.Double["extent"])
+    , steal_(var.Int("openmp_steal", 0))
+    , numa_(var.Int("openmp_numa", 0))
+    , balance_report_(var.Int("balance_report", 0))
+    , imbalance_report_(var.Int("imbalance_report", 0)) {
+  if (var.Int("perf_counters", 0)) {
+    perf_ = std::make_unique<PerfCounters>();
+    multitimer_all_.EnableCounters();
+    multitimer_report_.EnableCounters();
+  }
+  memtrack::SetEnabled(var.Int("report_memory", 0));
+  BufferPool::GetInstance().SetEnabled(var.Int("field_pool", 0));
+  BufferPool::GetInstance().SetPerThread(numa_);
+  BufferPool::GetInstance().SetCapacity(
+      var.Double("field_pool_capacity", 1024) * (1 << 20));
+  if (var.Int("openmp_affinity", 0)) {
+    PinThreads();
+  }
+}
 
 template <class M>
 DistrMesh<M>::~DistrMesh() {}
 
+template <class M>
+EventTrace::Scope DistrMesh<M>::TraceScope(const char* name) {
+#ifdef _OPENMP
+  const int tid = omp_get_thread_num();
+#else
+  const int tid = 0;
+#endif
+  return EventTrace::Scope(trace_.get(), name, tid);
+}
+
+template <class M>
+void DistrMesh<M>::WriteTrace() {
+  const int rank = MpiWrapper::GetCommRank(comm_);
+  const std::string format = var.String("trace_format", "chrome");
+  if (format.find("chrome") != std::string::npos) {
+    std::ofstream out(util::Format("trace_{}.json", rank));
+    trace_->WriteChrome(out);
+  }
+  if (format.find("folded") != std::string::npos) {
+    std::ofstream out(util::Format("trace_{}.folded", rank));
+    trace_->WriteFolded(out);
+  }
+}
+
 template <class M>
 void DistrMesh<M>::RunKernels(const std::vector<size_t>& bb) {
+  auto trace = TraceScope("compute");
+  const bool measure = balance_report_ || imbalance_report_;
+  SingleTimer compute_timer;
+  if (measure) {
+    block_time_.resize(kernels_.size(), 0);
+  }
+  if (perf_) {
+#ifdef _OPENMP
+    thread_counters_.resize(omp_get_max_threads());
+#else
+    thread_counters_.resize(1);
+#endif
+  }
+  if (steal_) {
+    RunKernelsSteal(bb);
+  } else if (numa_) {
+    RunKernelsFixed(bb);
+  } else {
 #pragma omp parallel for schedule(dynamic, 1)
-  for (size_t i = 0; i < bb.size(); ++i) {
-    kernels_[bb[i]]->Run();
+    for (size_t i = 0; i < bb.size(); ++i) {
+      auto trace_block = TraceScope("kernel");
+      if (measure) {
+        SingleTimer timer;
+        RunKernel(bb[i]);
+        block_time_[bb[i]] += timer.GetSeconds();
+      } else {
+        RunKernel(bb[i]);
+      }
+    }
+  }
+  if (measure) {
+    compute_time_ += compute_timer.GetSeconds();
+  }
+}
+
+template <class M>
+void DistrMesh<M>::RunKernel(size_t b) {
+  if (!perf_) {
+    kernels_[b]->Run();
+    return;
+  }
+  // Counters only measure the thread that opened them
+  thread_local PerfCounters perf;
+  const auto start = perf.Read();
+  kernels_[b]->Run();
+  const auto delta = PerfCounters::GetDelta(start, perf.Read());
+#ifdef _OPENMP
+  auto& sum = thread_counters_[omp_get_thread_num()];
+#else
+  auto& sum = thread_counters_[0];
+#endif
+  for (size_t i = 0; i < sum.size(); ++i) {
+    sum[i] += delta[i];
+  }
+}
+
+template <class M>
+void DistrMesh<M>::RunKernelsSteal(const std::vector<size_t>& bb) {
+#ifdef _OPENMP
+  const int nt = omp_get_max_threads();
+  block_thread_.resize(kernels_.size(), -1);
+  thread_stat_.resize(nt);
+
+  // Queue of blocks for each thread, new blocks are distributed round-robin
+  std::vector<std::deque<size_t>> queues(nt);
+  std::vector<std::mutex> locks(nt);
+  int next = 0;
+  for (auto b : bb) {
+    int& t = block_thread_[b];
+    if (t < 0 || t >= nt) {
+      t = next;
+      next = (next + 1) % nt;
+    }
+    queues[t].push_back(b);
+  }
+
+  std::vector<double> busy(nt, 0);
+  const double start = omp_get_wtime();
+#pragma omp parallel
+  {
+    const int tid = omp_get_thread_num();
+    auto& stat = thread_stat_[tid];
+    // Takes block from the front of own queue
+    // or from the back of queues of other threads
+    auto take = [&](size_t& b) {
+      for (int k = 0; k < nt; ++k) {
+        const int t = (tid + k) % nt;
+        std::lock_guard<std::mutex> lock(locks[t]);
+        auto& q = queues[t];
+        if (!q.empty()) {
+          if (k == 0) {
+            b = q.front();
+            q.pop_front();
+          } else {
+            b = q.back();
+            q.pop_back();
+            ++stat.steals;
+          }
+          return true;
+        }
+      }
+      return false;
+    };
+    size_t b;
+    while (take(b)) {
+      auto trace_block = TraceScope("kernel");
+      const double t0 = omp_get_wtime();
+      RunKernel(b);
+      const double t = omp_get_wtime() - t0;
+      busy[tid] += t;
+      if (balance_report_ || imbalance_report_) {
+        block_time_[b] += t;
+      }
+      block_thread_[b] = tid;
+      ++stat.blocks;
+    }
+  }
+  const double total = omp_get_wtime() - start;
+  for (int t = 0; t < nt; ++t) {
+    thread_stat_[t].busy += busy[t];
+    thread_stat_[t].idle += total - busy[t];
+  }
+#else
+  for (auto b : bb) {
+    SingleTimer timer;
+    RunKernel(b);
+    if (balance_report_ || imbalance_report_) {
+      block_time_[b] += timer.GetSeconds();
+    }
+  }
+#endif
+}
+
+template <class M>
+void DistrMesh<M>::RunKernelsFixed(const std::vector<size_t>& bb) {
+#ifdef _OPENMP
+  const int nt = omp_get_max_threads();
+  const size_t nb = kernels_.size();
+  if (block_thread_.size() != nb) {
+    // Contiguous ranges of blocks, neighbors share a thread
+    block_thread_.resize(nb);
+    for (size_t b = 0; b < nb; ++b) {
+      block_thread_[b] = b * nt / nb;
+    }
+  }
+  const bool measure = balance_report_ || imbalance_report_;
+#pragma omp parallel
+  {
+    const int tid = omp_get_thread_num();
+    for (auto b : bb) {
+      if (block_thread_[b] == tid) {
+        auto trace_block = TraceScope("kernel");
+        if (measure) {
+          SingleTimer timer;
+          RunKernel(b);
+          block_time_[b] += timer.GetSeconds();
+        } else {
+          RunKernel(b);
+        }
+      }
+    }
+  }
+#else
+  RunKernelsSteal(bb);
+#endif
+}
+
+template <class M>
+void DistrMesh<M>::PinThreads() {
+#if defined(_OPENMP) && defined(__linux__) && USEFLAG(MPI)
+  // Mask of the process before pinning, the main thread is pinned below
+  static const std::vector<int> allowed = topology::GetAllowedCpus();
+  // Ranks on the same node share the CPUs unless the launcher
+  // already bound each rank to a subset
+  MPI_Comm comm_local;
+  MPI_Comm_split_type(
+      comm_, MPI_COMM_TYPE_SHARED, 0, MPI_INFO_NULL, &comm_local);
+  int local_rank = 0;
+  int local_size = 1;
+  if (allowed.size() == topology::GetOnlineCpus().size()) {
+    MPI_Comm_rank(comm_local, &local_rank);
+    MPI_Comm_size(comm_local, &local_size);
+  }
+  MPI_Comm_free(&comm_local);
+  const auto cpus = topology::SelectCompact(
+      allowed, omp_get_max_threads(), local_rank, local_size);
+  fassert(!cpus.empty(), "openmp_affinity: no CPUs available");
+#pragma omp parallel
+  { SetAffinity(cpus[omp_get_thread_num() % cpus.size()]); }
+#else
+  if (isroot_) {
+    std::cerr << "openmp_affinity: not supported, ignoring" << std::endl;
+  }
+#endif
+}
+
+template <class M>
+void DistrMesh<M>::ReportBalance() {
+  // Global index, rank and cost of each block
+  const size_t nfields = dim + 2;
+  std::vector<double> buf;
+  const int rank = MpiWrapper::GetCommRank(comm_);
+  const int commsize = MpiWrapper::GetCommSize(comm_);
+  block_cost_.resize(kernels_.size(), 0);
+  for (size_t b = 0; b < kernels_.size(); ++b) {
+    auto& m = kernels_[b]->GetMesh();
+    const MIdx w = m.GetInBlockCells().GetBegin() / domain_.blocksize;
+    for (size_t d = 0; d < dim; ++d) {
+      buf.push_back(w[d]);
+    }
+    buf.push_back(rank);
+    buf.push_back(block_cost_[b]);
+  }
+
+#if USEFLAG(MPI)
+  // Gather data from all ranks on root
+  int size = buf.size();
+  std::vector<int> sizes(commsize);
+  MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, comm_);
+  std::vector<int> offsets(commsize + 1, 0);
+  for (int i = 0; i < commsize; ++i) {
+    offsets[i + 1] = offsets[i] + sizes[i];
+  }
+  std::vector<double> all(offsets.back());
+  MPI_Gatherv(
+      buf.data(), size, MPI_DOUBLE, all.data(), sizes.data(), offsets.data(),
+      MPI_DOUBLE, 0, comm_);
+  buf = all;
+  if (rank != 0) {
+    return;
+  }
+#endif
+
+  std::vector<MIdx> ww;
+  std::vector<int> ranks;
+  std::vector<double> cost;
+  for (size_t i = 0; i + nfields <= buf.size(); i += nfields) {
+    MIdx w;
+    for (size_t d = 0; d < dim; ++d) {
+      w[d] = buf[i + d];
+    }
+    ww.push_back(w);
+    ranks.push_back(buf[i + dim]);
+    cost.push_back(buf[i + dim + 1]);
+  }
+  const auto part =
+      balance::Partition(cost, balance::GetMortonOrder<dim>(ww), commsize);
+
+  std::cerr << util::Format(
+                   "balance: imbalance current={:.3f} partition={:.3f}",
+                   balance::GetImbalance(cost, ranks, commsize),
+                   balance::GetImbalance(cost, part, commsize))
+            << std::endl;
+  std::ofstream out("balance.csv");
+  const std::string xyz = "xyzw";
+  for (size_t d = 0; d < dim; ++d) {
+    out << xyz[d] << ',';
+  }
+  out << "rank,cost,partition\n";
+  for (size_t b = 0; b < ww.size(); ++b) {
+    for (size_t d = 0; d < dim; ++d) {
+      out << ww[b][d] << ',';
+    }
+    out << ranks[b] << ',' << cost[b] << ',' << part[b] << '\n';
   }
 }
 
@@ -111,17 +430,206 @@ template <class M>
 void DistrMesh<M>::TimerReport(const std::vector<size_t>& bb) {
   auto& m = kernels_.front()->GetMesh();
   std::string fn = m.GetTimerReport();
-  if (fn.length()) {
-    std::ofstream out;
-    out.open(fn);
-    out << "mem=" << (sysinfo::GetMem() / double(1 << 20)) << " MB"
-        << std::endl;
-    ParseReport(multitimer_report_.GetMap(), out);
+  int request = !fn.empty();
+#if USEFLAG(MPI)
+  if (imbalance_report_) {
+    // Imbalance report is collective, so report if any rank requested.
+    MPI_Allreduce(MPI_IN_PLACE, &request, 1, MPI_INT, MPI_MAX, comm_);
+  }
+#endif
+  if (request) {
+    if (isroot_ && !fn.empty()) {
+      std::ofstream out;
+      out.open(fn);
+      out << "mem=" << (sysinfo::GetMem() / double(1 << 20)) << " MB"
+          << std::endl;
+      ParseReport(multitimer_report_.GetMap(), out);
+      if (perf_) {
+        ReportCounters(multitimer_report_.GetCounters(), *perf_, out);
+      }
+    }
     multitimer_report_.Reset();
+    if (imbalance_report_) {
+      ReportImbalance(fn);
+    }
   }
   ClearTimerReport(bb);
 }
 
+template <class M>
+void DistrMesh<M>::CollectBlockTime(const std::string& stage) {
+  block_time_.resize(kernels_.size(), 0);
+  if (balance_report_) {
+    block_cost_.resize(kernels_.size(), 0);
+    for (size_t b = 0; b < kernels_.size(); ++b) {
+      block_cost_[b] += block_time_[b];
+    }
+  }
+  if (imbalance_report_) {
+    auto& st = imbalance_[stage];
+    st.compute += compute_time_;
+    st.blocks.resize(kernels_.size(), 0);
+    for (size_t b = 0; b < kernels_.size(); ++b) {
+      st.blocks[b] += block_time_[b];
+    }
+  }
+  std::fill(block_time_.begin(), block_time_.end(), 0);
+  compute_time_ = 0;
+}
+
+template <class M>
+void DistrMesh<M>::ReportImbalance(const std::string& path) {
+  const int rank = MpiWrapper::GetCommRank(comm_);
+  const int commsize = MpiWrapper::GetCommSize(comm_);
+  // Stages are the same on all ranks, ordered by name
+  std::vector<std::string> names;
+  std::vector<double> compute; // time of each stage on current rank
+  for (auto& p : imbalance_) {
+    names.push_back(p.first);
+    compute.push_back(p.second.compute);
+  }
+  const int nstages = names.size();
+
+  // Time of stages on all ranks, element [rank * nstages + stage]
+  std::vector<double> all = compute;
+#if USEFLAG(MPI)
+  {
+    int nmin = nstages;
+    int nmax = nstages;
+    MPI_Allreduce(MPI_IN_PLACE, &nmin, 1, MPI_INT, MPI_MIN, comm_);
+    MPI_Allreduce(MPI_IN_PLACE, &nmax, 1, MPI_INT, MPI_MAX, comm_);
+    fassert(nmin == nmax, "Ranks have different number of stages");
+    all.resize(commsize * nstages);
+    MPI_Gather(
+        compute.data(), nstages, MPI_DOUBLE, all.data(), nstages, MPI_DOUBLE,
+        0, comm_);
+  }
+#endif
+
+  struct Stat {
+    double min;
+    double mean;
+    double max;
+    int argmax; // rank with maximum time
+    double GetRatio() const {
+      return mean > 0 ? max / mean : 1;
+    }
+  };
+  std::vector<Stat> stats(nstages);
+  // Stages with the highest ratio max/mean, at most `imbalance_report_worst`
+  std::vector<int> worst;
+  if (rank == 0) {
+    for (int s = 0; s < nstages; ++s) {
+      auto& st = stats[s];
+      st.min = all[s];
+      st.max = all[s];
+      st.mean = 0;
+      st.argmax = 0;
+      for (int r = 0; r < commsize; ++r) {
+        const double t = all[r * nstages + s];
+        st.min = std::min(st.min, t);
+        st.mean += t / commsize;
+        if (t > st.max) {
+          st.max = t;
+          st.argmax = r;
+        }
+      }
+      worst.push_back(s);
+    }
+    std::stable_sort(worst.begin(), worst.end(), [&stats](int a, int b) {
+      return stats[a].GetRatio() > stats[b].GetRatio();
+    });
+    worst.resize(std::min<size_t>(
+        worst.size(), var.Int("imbalance_report_worst", 5)));
+  }
+  int nworst = worst.size();
+#if USEFLAG(MPI)
+  MPI_Bcast(&nworst, 1, MPI_INT, 0, comm_);
+  worst.resize(nworst);
+  MPI_Bcast(worst.data(), nworst, MPI_INT, 0, comm_);
+#endif
+
+  // Global index and time in worst stages for each block
+  const size_t nfields = dim + 1 + nworst;
+  std::vector<double> buf;
+  for (size_t b = 0; b < kernels_.size(); ++b) {
+    auto& m = kernels_[b]->GetMesh();
+    const MIdx w = m.GetInBlockCells().GetBegin() / domain_.blocksize;
+    for (size_t d = 0; d < dim; ++d) {
+      buf.push_back(w[d]);
+    }
+    buf.push_back(rank);
+    for (auto s : worst) {
+      const auto& blocks = imbalance_[names[s]].blocks;
+      buf.push_back(b < blocks.size() ? blocks[b] : 0);
+    }
+  }
+  imbalance_.clear();
+
+#if USEFLAG(MPI)
+  {
+    int size = buf.size();
+    std::vector<int> sizes(commsize);
+    MPI_Gather(&size, 1, MPI_INT, sizes.data(), 1, MPI_INT, 0, comm_);
+    std::vector<int> offsets(commsize + 1, 0);
+    for (int i = 0; i < commsize; ++i) {
+      offsets[i + 1] = offsets[i] + sizes[i];
+    }
+    std::vector<double> allbuf(offsets.back());
+    MPI_Gatherv(
+        buf.data(), size, MPI_DOUBLE, allbuf.data(), sizes.data(),
+        offsets.data(), MPI_DOUBLE, 0, comm_);
+    buf = allbuf;
+  }
+#endif
+  if (rank != 0 || path.empty()) {
+    return;
+  }
+
+  const std::string base = util::SplitExt(path)[0];
+  {
+    std::ofstream out(base + "_imbalance.csv");
+    out << "stage,min,mean,max,argmax,ratio\n";
+    for (int s = 0; s < nstages; ++s) {
+      auto& st = stats[s];
+      out << '"' << names[s] << '"' << ',' << st.min << ',' << st.mean << ','
+          << st.max << ',' << st.argmax << ',' << st.GetRatio() << '\n';
+    }
+  }
+  {
+    const size_t nblocks = buf.size() / nfields;
+    const size_t maxblocks = var.Int("imbalance_report_blocks", 5);
+    std::ofstream out(base + "_imbalance.json");
+    out << "{\n  \"worst\": [";
+    for (int i = 0; i < nworst; ++i) {
+      const int s = worst[i];
+      auto& st = stats[s];
+      out << (i ? "," : "") << "\n    {\"stage\": \"" << names[s] << "\""
+          << ", \"ratio\": " << st.GetRatio() << ", \"min\": " << st.min
+          << ", \"mean\": " << st.mean << ", \"max\": " << st.max
+          << ", \"argmax\": " << st.argmax << ",\n     \"blocks\": [";
+      // Slowest blocks in stage
+      std::vector<size_t> order(nblocks);
+      std::iota(order.begin(), order.end(), 0);
+      auto time = [&](size_t b) { return buf[b * nfields + dim + 1 + i]; };
+      std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+        return time(a) > time(b);
+      });
+      for (size_t k = 0; k < std::min(maxblocks, nblocks); ++k) {
+        const size_t b = order[k];
+        out << (k ? ", " : "") << "{\"block\": [";
+        for (size_t d = 0; d < dim; ++d) {
+          out << (d ? ", " : "") << buf[b * nfields + d];
+        }
+        out << "], \"rank\": " << buf[b * nfields + dim]
+            << ", \"time\": " << time(b) << "}";
+      }
+      out << "]}";
+    }
+    out << "\n  ]\n}\n";
+  }
+}
+
 template <class M>
 void DistrMesh<M>::ClearTimerReport(const std::vector<size_t>& bb) {
   for (auto b : bb) {
@@ -153,6 +661,142 @@ void DistrMesh<M>::Reduce(const std::vector<size_t>& bb) {
   }
 }
 
+template <class M>
+void DistrMesh<M>::ReduceDeferred(const std::vector<size_t>& bb) {
+  using OpScal = typename UReduce<Scal>::OpS;
+  using OpScalInt = typename UReduce<Scal>::OpSI;
+  auto& mfirst = kernels_.front()->GetMesh();
+  const bool wait = mfirst.GetWaitReduce();
+  std::vector<std::vector<std::unique_ptr<RedOp>>> reqs; // for each block
+  for (auto b : bb) {
+    auto& m = kernels_[b]->GetMesh();
+    reqs.push_back(m.ReleaseReduceDeferred());
+    fassert_equal(reqs.back().size(), reqs.front().size());
+    fassert_equal(m.GetWaitReduce(), wait);
+    m.ClearWaitReduce();
+  }
+
+#if USEFLAG(MPI)
+  const auto mscal = (sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT);
+  const auto mscalint = (sizeof(Scal) == 8 ? MPI_DOUBLE_INT : MPI_FLOAT_INT);
+#endif
+  // Requests of UReduce::OpS with the same operation are fused
+  // into one reduction over ranks.
+  enum class Kind { sum, prod, max, min, loc };
+  std::map<Kind, DeferredReduce*> fused;
+  for (size_t i = 0; i < (reqs.empty() ? 0 : reqs.front().size()); ++i) {
+    std::vector<std::unique_ptr<RedOp>> blocks;
+    for (auto& r : reqs) {
+      blocks.push_back(std::move(r[i]));
+    }
+    auto* firstbase = blocks.front().get();
+    Kind kind = Kind::sum;
+    if (dynamic_cast<typename UReduce<Scal>::OpSum*>(firstbase)) {
+      kind = Kind::sum;
+    } else if (dynamic_cast<typename UReduce<Scal>::OpProd*>(firstbase)) {
+      kind = Kind::prod;
+    } else if (dynamic_cast<typename UReduce<Scal>::OpMax*>(firstbase)) {
+      kind = Kind::max;
+    } else if (dynamic_cast<typename UReduce<Scal>::OpMin*>(firstbase)) {
+      kind = Kind::min;
+    } else if (dynamic_cast<OpScalInt*>(firstbase)) {
+      kind = Kind::loc;
+    } else {
+      fassert(false, "Unknown deferred reduction");
+    }
+    if (kind == Kind::loc) {
+      // Reduce over blocks on current rank and start reduction over ranks
+      deferred_.emplace_back();
+      auto& d = deferred_.back();
+      auto* first = dynamic_cast<OpScalInt*>(firstbase);
+      d.value_loc = first->Neutral();
+      for (auto& op : blocks) {
+        dynamic_cast<OpScalInt*>(op.get())->Append(d.value_loc);
+      }
+#if USEFLAG(MPI)
+      MPI_Op mpiop;
+      if (dynamic_cast<typename UReduce<Scal>::OpMinloc*>(first)) {
+        mpiop = MPI_MINLOC;
+      } else if (dynamic_cast<typename UReduce<Scal>::OpMaxloc*>(first)) {
+        mpiop = MPI_MAXLOC;
+      } else {
+        fassert(false, "Unknown reduction");
+      }
+      MPI_Iallreduce(
+          MPI_IN_PLACE, &d.value_loc, 1, mscalint, mpiop, comm_, &d.request);
+#endif
+      d.blocks.push_back(std::move(blocks));
+      continue;
+    }
+    auto*& d = fused[kind];
+    if (!d) {
+      deferred_.emplace_back();
+      d = &deferred_.back();
+    }
+    // Reduce over blocks on current rank
+    Scal value = dynamic_cast<OpScal*>(firstbase)->Neutral();
+    for (auto& op : blocks) {
+      dynamic_cast<OpScal*>(op.get())->Append(value);
+    }
+    d->values.push_back(value);
+    d->blocks.push_back(std::move(blocks));
+  }
+  // Start reductions over ranks
+  for (auto& p : fused) {
+    auto& d = *p.second;
+#if USEFLAG(MPI)
+    MPI_Op mpiop;
+    switch (p.first) {
+      case Kind::sum:
+        mpiop = MPI_SUM;
+        break;
+      case Kind::prod:
+        mpiop = MPI_PROD;
+        break;
+      case Kind::max:
+        mpiop = MPI_MAX;
+        break;
+      default:
+        mpiop = MPI_MIN;
+        break;
+    }
+    MPI_Iallreduce(
+        MPI_IN_PLACE, d.values.data(), d.values.size(), mscal, mpiop, comm_,
+        &d.request);
+#else
+    (void)d;
+#endif
+  }
+
+  if (wait) {
+    WaitReduceDeferred();
+  }
+}
+
+template <class M>
+void DistrMesh<M>::WaitReduceDeferred() {
+  using OpScal = typename UReduce<Scal>::OpS;
+  using OpScalInt = typename UReduce<Scal>::OpSI;
+  for (auto& d : deferred_) {
+#if USEFLAG(MPI)
+    {
+      auto trace = TraceScope("mpi_wait");
+      MPI_Wait(&d.request, MPI_STATUS_IGNORE);
+    }
+#endif
+    for (size_t i = 0; i < d.blocks.size(); ++i) {
+      for (auto& op : d.blocks[i]) {
+        if (auto* o = dynamic_cast<OpScal*>(op.get())) {
+          o->Set(d.values[i]);
+        } else if (auto* osi = dynamic_cast<OpScalInt*>(op.get())) {
+          osi->Set(d.value_loc);
+        }
+      }
+    }
+  }
+  deferred_.clear();
+}
+
 template <class M>
 void DistrMesh<M>::ReduceShared(const std::vector<size_t>&) {
   const size_t nreqs = mshared_->GetReduce().size();
@@ -469,28 +1113,68 @@ void DistrMesh<M>::Run() {
   if (var.Int["verbose_openmp"]) {
     ReportOpenmp();
   }
+  if (var.Int("trace", 0)) {
+#ifdef _OPENMP
+    const int nthreads = omp_get_max_threads();
+#else
+    const int nthreads = 1;
+#endif
+#if USEFLAG(MPI)
+    MPI_Barrier(comm_); // align the start of timelines on all ranks
+#endif
+    trace_ = std::make_unique<EventTrace>(
+        MpiWrapper::GetCommRank(comm_), nthreads,
+        var.Int("trace_max_events", 1000000));
+  }
   while (true) {
     multitimer_all_.Push();
     multitimer_report_.Push();
 
     std::vector<size_t> bb;
     if (kernels_.front()->GetMesh().GetDump().size() > 0) {
-      bb = TransferHalos(); // all blocks, sync communication
+      {
+        auto trace = TraceScope("halo");
+        bb = TransferHalos(); // all blocks, sync communication
+      }
       // ApplyNanFaces(bb);
-      DumpWrite(bb);
+      {
+        auto trace = TraceScope("dump");
+        DumpWrite(bb);
+      }
       ClearDump(bb);
       ClearComm(bb);
       mshared_->ClearComm();
       RunKernels(bb);
     } else {
-      auto bbi = TransferHalos(true); // inner blocks, async communication
+      std::vector<size_t> bbi;
+      {
+        auto trace = TraceScope("halo");
+        bbi = TransferHalos(true); // inner blocks, async communication
+      }
       ClearComm(bbi);
       mshared_->ClearComm();
       RunKernels(bbi);
 
-      auto bbh = TransferHalos(false); // halo blocks, wait for communication
-      ClearComm(bbh);
-      RunKernels(bbh);
+      // halo blocks, run as soon as their halos are received
+      std::vector<size_t> bbh;
+      auto next = [this]() {
+        auto trace = TraceScope("halo");
+        return TransferHalosNext();
+      };
+      for (auto bbr = next(); !bbr.empty(); bbr = next()) {
+        ClearComm(bbr);
+        RunKernels(bbr);
+        bbh.insert(bbh.end(), bbr.begin(), bbr.end());
+      }
+
+      std::vector<size_t> bbr;
+      {
+        auto trace = TraceScope("halo");
+        bbr = TransferHalos(false); // remaining halo blocks, wait
+      }
+      ClearComm(bbr);
+      RunKernels(bbr);
+      bbh.insert(bbh.end(), bbr.begin(), bbr.end());
 
       bb = bbi;
       bb.insert(bb.end(), bbh.begin(), bbh.end());
@@ -510,35 +1194,82 @@ void DistrMesh<M>::Run() {
         auto& m = kernels_[b]->GetMesh();
         fassert(
             m.GetSuspender().GetNameSequence() ==
-                mf.GetSuspender().GetNameSequence(),
+                    mf.GetSuspender().GetNameSequence() &&
+                m.GetSuspender().GetYieldCount() ==
+                    mf.GetSuspender().GetYieldCount(),
             util::Format(
-                "Blocks {} and {} diverged to different stages {} and {}",
+                "Blocks {} and {} diverged to different stages {}#{} and "
+                "{}#{}",
                 m.GetId(), mf.GetId(), m.GetSuspender().GetNameSequence(),
-                mf.GetSuspender().GetNameSequence()));
+                m.GetSuspender().GetYieldCount(),
+                mf.GetSuspender().GetNameSequence(),
+                mf.GetSuspender().GetYieldCount()));
       }
     }
 
-    Reduce(bb);
-    ReduceToLead(bb);
-    ReduceShared(bb);
-    Scatter(bb);
-    Bcast(bb);
-    BcastFromLead(bb);
+    {
+      auto trace = TraceScope("reduce");
+      Reduce(bb);
+      ReduceDeferred(bb);
+      ReduceToLead(bb);
+      ReduceShared(bb);
+    }
+    {
+      auto trace = TraceScope("scatter");
+      Scatter(bb);
+    }
+    {
+      auto trace = TraceScope("bcast");
+      Bcast(bb);
+      BcastFromLead(bb);
+    }
 
     const std::string nameseq =
         kernels_.front()->GetMesh().GetSuspender().GetNameSequence();
+    if (perf_) {
+      PerfCounters::Values sum{};
+      for (auto& counters : thread_counters_) {
+        for (size_t i = 0; i < sum.size(); ++i) {
+          sum[i] += counters[i];
+        }
+        counters.fill(0);
+      }
+      multitimer_all_.AddCounters(sum);
+      multitimer_report_.AddCounters(sum);
+    }
     multitimer_all_.Pop(nameseq);
     multitimer_report_.Pop(nameseq);
+    if (balance_report_ || imbalance_report_) {
+      CollectBlockTime(nameseq);
+    }
     TimerReport(bb);
 
-    if (!Pending(bb)) {
+    const bool pending = Pending(bb);
+    if (!pending) {
+      auto trace = TraceScope("reduce");
+      WaitReduceDeferred();
+    }
+    if (trace_) {
+      trace_->EndStage(nameseq);
+    }
+    if (!pending) {
       break;
     }
   }
 
+  if (trace_) {
+    WriteTrace();
+  }
+
   if (var.Int["verbose_time"]) {
     Report();
   }
+  if (var.Int["verbose_openmp"] && !thread_stat_.empty()) {
+    ReportOpenmp();
+  }
+  if (balance_report_) {
+    ReportBalance();
+  }
 }
 
 template <class M>
@@ -555,6 +1286,9 @@ void DistrMesh<M>::Report() {
       std::cerr << "mem=" << (sysinfo::GetMem() / double(1 << 20)) << " MB"
                 << std::endl;
       ParseReport(map, std::cerr);
+      if (perf_) {
+        ReportCounters(multitimer_all_.GetCounters(), *perf_, std::cerr);
+      }
     }
 
     const auto& m = kernels_.front()->GetMesh();
@@ -584,6 +1318,16 @@ void DistrMesh<M>::Report() {
                      nc, nt, ni, total, hmsm[0], hmsm[1], hmsm[2], hmsm[3],
                      total / (nc * ni))
               << std::endl;
+
+    if (var.Int("field_pool_stat", 0)) {
+      const auto stat = BufferPool::GetInstance().GetStat();
+      std::cerr << util::Format(
+                       "field_pool: hits={} misses={} cached={:.3f} MB "
+                       "peak_cached={:.3f} MB\n",
+                       stat.hits, stat.misses, stat.cached / double(1 << 20),
+                       stat.peak_cached / double(1 << 20))
+                << std::endl;
+    }
   }
 }
 
@@ -599,9 +1343,19 @@ void DistrMesh<M>::ReportOpenmp() {
       for (int i = 0; i < omp_get_num_threads(); ++i) {
 #pragma omp ordered
         {
-          std::cerr << "thread=" << std::setw(2) << omp_get_thread_num();
-          std::cerr << std::setw(8) << " cpu=" << std::setw(2)
-                    << sched_getcpu();
+          const int tid = omp_get_thread_num();
+          std::cerr << "thread=" << std::setw(2) << tid;
+          const auto cpu = topology::GetCpu(sched_getcpu());
+          std::cerr << std::setw(8) << " cpu=" << std::setw(2) << cpu.id;
+          std::cerr << " core=" << std::setw(2) << cpu.core
+                    << " socket=" << cpu.socket << " node=" << cpu.node;
+          if (size_t(tid) < thread_stat_.size()) {
+            auto& stat = thread_stat_[tid];
+            std::cerr << std::fixed << std::setprecision(3)
+                      << " busy=" << stat.busy << " idle=" << stat.idle
+                      << " blocks=" << stat.blocks
+                      << " steals=" << stat.steals;
+          }
           std::cerr << std::endl;
         }
       }
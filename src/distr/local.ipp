@@ -146,6 +146,7 @@ auto Local<M>::TransferHalos(bool inner) -> std::vector<size_t> {
 template <class M>
 void Local<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
   using OpScal = typename UReduce<Scal>::OpS;
+  using OpSumV = typename UReduce<Scal>::OpSumV;
   using OpScalInt = typename UReduce<Scal>::OpSI;
   using OpConcat = typename UReduce<Scal>::OpCat;
 
@@ -165,6 +166,20 @@ void Local<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
     }
     return;
   }
+  if (auto* first = dynamic_cast<OpSumV*>(firstbase)) {
+    auto buf = first->Neutral();
+
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Append(buf);
+    }
+
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Set(buf);
+    }
+    return;
+  }
   if (auto* first = dynamic_cast<OpScalInt*>(firstbase)) {
     auto buf = first->Neutral();
 
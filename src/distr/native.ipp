@@ -3,16 +3,22 @@
 
 #pragma once
 
+#include <algorithm>
+#include <array>
 #include <cassert>
+#include <fstream>
 #include <map>
 #include <memory>
 #include <numeric>
 #include <stdexcept>
 
+#include "balance.h"
 #include "comm_manager.h"
 #include "distr.h"
 #include "dump/dumper.h"
+#include "util/compressor.h"
 #include "util/format.h"
+#include "util/memtrack.h"
 #include "util/mpi.h"
 
 template <class M_>
@@ -32,12 +38,148 @@ class Native : public DistrMesh<M_> {
   using MIdx = typename M::MIdx;
   using P::dim;
 
-  // reqs[i] is communication requests from `kernels_[i]`
   using CommRequest = typename M::CommRequest;
+  using CommStencil = typename M::CommStencil;
+  using Tasks = typename CommManager<dim>::Tasks;
+  using Task = typename CommManager<dim>::Task;
+  using LocalCell = typename CommManager<dim>::LocalCell;
+  // Field of one communication request from all blocks
+  struct FieldReq {
+    std::vector<Scal*> data; // data of field for each block
+    size_t stride; // number of scalars per cell in field
+    size_t offset; // first component to transfer
+    size_t size; // number of components to transfer
+    Scal tol; // error tolerance for compression, zero for lossless
+  };
+  // List of cells split into segments of consecutive cells from one block
+  struct CellList {
+    struct Segment {
+      size_t block;
+      size_t begin;
+      size_t end;
+    };
+    std::vector<size_t> cells; // raw indices of cells
+    std::vector<Segment> segments;
+  };
+  // Number of stencils, indices follow the order of GetStencils()
+  static constexpr size_t kNumStencils = 4;
+  template <class T>
+  using StencilArray = std::array<T, kNumStencils>;
+  static StencilArray<CommStencil> GetStencils() {
+    return {
+        CommStencil::full_two, CommStencil::full_one, CommStencil::direct_two,
+        CommStencil::direct_one};
+  }
+  // Message to or from one rank with cells for all stencils
+  struct Message {
+    int rank;
+    StencilArray<CellList> cells; // cells for each stencil
+  };
+  // Buffers and persistent requests reused for all messages
+  // with the same number of scalars per cell for each stencil.
+  struct Channel {
+    std::vector<std::vector<Scal>> send_buf; // buffer for each message
+    std::vector<std::vector<Scal>> recv_buf;
+    memtrack::Account mem{memtrack::GetTag("comm")}; // memory of buffers
+#if USEFLAG(MPI)
+    std::vector<MPI_Request> send_req; // request for each message
+    std::vector<MPI_Request> recv_req;
+    // Messages to ranks on the same node go through a shared-memory window:
+    // the sender packs data to its window, the receiver unpacks directly
+    // from there, and send_req and recv_req only carry notifications.
+    MPI_Win win = MPI_WIN_NULL;
+    std::vector<bool> send_shared; // true if message goes through window
+    std::vector<bool> recv_shared;
+    std::vector<Scal*> send_ptr; // data of message in own window
+    std::vector<const Scal*> recv_ptr; // data of message in window of sender
+    // Notifications that the receiver has read the data from window,
+    // MPI_REQUEST_NULL for messages not going through window
+    std::vector<MPI_Request> done_send; // for each received message
+    std::vector<MPI_Request> done_recv; // for each sent message
+    bool done_active = false; // true if done_recv are started
+    // Messages to other nodes that are compressed or sparse change size
+    // between transfers, so they are sent with non-persistent requests.
+    // Their data starts with a flag: 1 if encoded with EncodeRuns(),
+    // 0 otherwise.
+    std::vector<bool> send_varsize; // true if message has variable size
+    std::vector<bool> recv_varsize;
+    std::vector<std::vector<Scal>> send_zbuf; // encoded data
+    std::vector<std::vector<Scal>> recv_zbuf;
+#endif
+  };
+  // Communication plan compiled from CommManager::Tasks.
+  // Fields with all stencils are sent in one message to each rank.
+  struct Plan {
+    std::vector<Message> send; // messages to other ranks
+    std::vector<Message> recv; // messages from other ranks
+    // Cells to copy between blocks on current rank, in matching order
+    StencilArray<std::vector<LocalCell>> local_send;
+    StencilArray<std::vector<LocalCell>> local_recv;
+    // remote_blocks[s][b] is true if block `b` receives halos
+    // from other ranks with stencil `s`
+    StencilArray<std::vector<bool>> remote_blocks;
+    // number of scalars per cell for each stencil to channel
+    std::map<StencilArray<size_t>, Channel> channels;
+  };
+  static StencilArray<const Task*> GetTasks(const Tasks& tasks);
+  static CellList MakeCellList(const std::vector<LocalCell>& cells);
+  Plan MakePlan(const Tasks& tasks, size_t nblocks) const;
+  // Returns channel for messages of `plan` with `nscal[s]` scalars per cell
+  // for stencil `s`. Creates buffers and persistent requests on first call.
+  Channel& GetChannel(Plan& plan, const StencilArray<size_t>& nscal);
+#if USEFLAG(MPI)
+  // Creates shared-memory window for messages to ranks on the same node
+  // and replaces their persistent requests with notifications.
+  // Collective over comm_node_.
+  void InitSharedWindow(
+      Plan& plan, Channel& ch, const std::vector<size_t>& send_size);
+#endif
+  // Returns rank in comm_node_ of `rank` in comm_,
+  // or -1 if on another node or shared memory is disabled
+  int GetNodeRank(int rank) const;
+  void FreeChannels(Plan& plan);
+  // Writes values of field in `cells` to `buf`, returns end of written data.
+  static Scal* Pack(const FieldReq&, const CellList& cells, Scal* buf);
+  // Reads values of field in `cells` from `buf`, returns end of read data.
+  static const Scal* Unpack(
+      const FieldReq&, const CellList& cells, const Scal* buf);
+  // Writes values of field in `cells` to `buf` in sparse format,
+  // returns end of written data. Each segment starts with a header `k`:
+  // k > 0 is followed by one value for k cells with equal values,
+  // k < 0 is followed by values for -k cells.
+  // Writes at most twice the size of data written by Pack().
+  static Scal* PackSparse(const FieldReq&, const CellList& cells, Scal* buf);
+  // Reads values of field in `cells` from `buf` in sparse format,
+  // returns end of read data.
+  static const Scal* UnpackSparse(
+      const FieldReq&, const CellList& cells, const Scal* buf);
+  // Copies values of field from cells `send` to cells `recv`.
+  static void CopyLocal(
+      const FieldReq&, const std::vector<LocalCell>& send,
+      const std::vector<LocalCell>& recv);
+  // Starts communication of halos: starts receives and sends to other ranks,
+  // and copies halos between blocks on the current rank.
+  // reqs[i] is communication requests from `kernels_[i]`
+  void StartTransfer(
+      const std::vector<std::vector<CommRequest*>>& reqs, Plan& plan);
+  // Waits for communication started by StartTransfer()
+  // and writes received halos to fields.
+  void FinishTransfer();
+  // Waits for at least one message started by StartTransfer() and writes
+  // received halos to fields. Returns blocks that have received all
+  // messages, or an empty list if the communication is finished.
+  std::vector<size_t> FinishTransferSome();
+#if USEFLAG(MPI)
+  // Writes halos from received message `i` to fields.
+  void UnpackMessage(size_t i, const MPI_Status& status);
+  // Waits for sends started by StartTransfer().
+  void FinishSends();
+#endif
+  // Communicates halos synchronously.
   void TransferHalos(
-      std::vector<std::vector<const CommRequest*>>& reqs,
-      const typename CommManager<dim>::Tasks& tasks);
+      const std::vector<std::vector<CommRequest*>>& reqs, Plan& plan);
   std::vector<size_t> TransferHalos(bool inner) override;
+  std::vector<size_t> TransferHalosNext() override;
   void ReduceSingleRequest(const std::vector<RedOp*>& blocks) override;
   void Bcast(const std::vector<size_t>& bb) override;
   void Scatter(const std::vector<size_t>& bb) override;
@@ -55,24 +197,50 @@ class Native : public DistrMesh<M_> {
 
   int commsize_;
   int commrank_;
-  // communication tasks
-  typename CommManager<dim>::Tasks tasks_;
-  // communication tasks for shared mesh
-  typename CommManager<dim>::Tasks tasks_shared_;
-  struct ReqTmp {
+  // Rank of each block, indexed by GIndex of global block index.
+  // Boxes of domain_.nblocks by default, or read from balance_partition.
+  std::vector<int> block_rank_;
+  std::vector<size_t> rank_nblocks_; // number of blocks on each rank
+  bool partition_; // blocks assigned by balance_partition
+  Plan plan_; // communication plan
+  Plan plan_shared_; // communication plan for shared mesh
+  struct Transfer {
+    Plan* plan = nullptr;
+    Channel* channel = nullptr;
+    StencilArray<std::vector<FieldReq>> fields; // fields for each stencil
+  };
+  Transfer transfer_; // communication in progress
+  // Overlap communication with computation:
+  // 1: in blocks that do not need halos from other ranks,
+  // 2: also in blocks that have received all their messages
+  int overlap_;
 #if USEFLAG(MPI)
-    MPI_Request req;
-    size_t cnt = 0;
+  // Pass halos to ranks on the same node through shared memory
+  bool shared_memory_;
+  MPI_Comm comm_node_ = MPI_COMM_NULL; // ranks on the same node
+  std::vector<int> node_rank_; // rank in comm_node_ for each rank in comm_
+  // Compress halos sent to other nodes
+  bool compress_;
+  size_t compress_bytes_; // minimal size of message to compress in bytes
+  Scal compress_tol_; // error tolerance for fields with CommRequest::lossy
+  // Send one value for segments of halo cells with equal values
+  bool sparse_;
+  // Sections of message to compress with the same tolerance,
+  // pairs of end offset and tolerance
+  std::vector<std::pair<size_t, Scal>> sections_;
 #endif
-    std::vector<Scal> buf;
-  };
-  std::map<int, ReqTmp> tmp_send_; // rank to request
-  std::map<int, ReqTmp> tmp_recv_;
+  // blocks waiting for communication started with TransferHalos(true)
+  std::vector<size_t> halo_blocks_;
+  // Number of messages not yet received for each block
+  std::vector<size_t> pending_messages_;
+  // Blocks receiving halos from each message
+  std::vector<std::vector<size_t>> message_blocks_;
 };
 
 template <class M>
 Native<M>::Native(MPI_Comm comm, const KernelMeshFactory<M>& kf, Vars& var_)
-    : DistrMesh<M>(comm, kf, var_) {
+    : DistrMesh<M>(comm, kf, var_)
+    , overlap_(var.Int("native_overlap", 0)) {
   MpiWrapper mpi(comm_);
   commsize_ = mpi.GetCommSize();
   commrank_ = mpi.GetCommRank();
@@ -84,26 +252,92 @@ Native<M>::Native(MPI_Comm comm, const KernelMeshFactory<M>& kf, Vars& var_)
           "Number of MPI tasks {} does not match the number of subdomains {}",
           commsize_, domain_.nprocs));
 
+#if USEFLAG(MPI)
+  shared_memory_ = var.Int("native_shared_memory", 0);
+  if (shared_memory_) {
+    MPI_Comm_split_type(
+        comm_, MPI_COMM_TYPE_SHARED, commrank_, MPI_INFO_NULL, &comm_node_);
+    MPI_Group group, group_node;
+    MPI_Comm_group(comm_, &group);
+    MPI_Comm_group(comm_node_, &group_node);
+    std::vector<int> ranks(commsize_);
+    std::iota(ranks.begin(), ranks.end(), 0);
+    node_rank_.resize(commsize_);
+    MPI_Group_translate_ranks(
+        group, commsize_, ranks.data(), group_node, node_rank_.data());
+    MPI_Group_free(&group);
+    MPI_Group_free(&group_node);
+  }
+  compress_ = var.Int("native_compress", 0);
+  compress_bytes_ = var.Int("native_compress_bytes", 4096);
+  compress_tol_ = var.Double("native_compress_tol", 0);
+  sparse_ = var.Int("native_sparse", 0);
+#endif
+
   const MIdx globalsize = domain_.nprocs * domain_.nblocks * domain_.blocksize;
+  const GIndex<size_t, dim> procs(domain_.nprocs);
+  const GIndex<size_t, dim> gblocks(domain_.nprocs * domain_.nblocks);
+  block_rank_.resize(gblocks.size());
+  for (auto i : gblocks.Range()) {
+    block_rank_[i] = procs.GetIdx(gblocks.GetMIdx(i) / domain_.nblocks);
+  }
+  const std::string partition_path = var.String("balance_partition", "");
+  partition_ = !partition_path.empty();
+  if (partition_) {
+    std::ifstream fin(partition_path);
+    fassert(
+        fin.good(), "Can't open balance_partition '" + partition_path + "'");
+    std::vector<bool> found(gblocks.size(), false);
+    for (auto p : balance::ReadPartition<dim>(fin)) {
+      fassert(
+          gblocks.IsInside(p.first),
+          util::Format(
+              "balance_partition: block {} outside of {}", p.first,
+              gblocks.GetSize()));
+      fassert(
+          p.second >= 0 && p.second < commsize_,
+          util::Format(
+              "balance_partition: invalid rank {} of block {}", p.second,
+              p.first));
+      const size_t i = gblocks.GetIdx(p.first);
+      block_rank_[i] = p.second;
+      found[i] = true;
+    }
+    fassert(
+        std::all_of(found.begin(), found.end(), [](bool b) { return b; }),
+        "balance_partition: some blocks are missing in '" + partition_path +
+            "'");
+  }
+  rank_nblocks_.assign(commsize_, 0);
+  for (auto rank : block_rank_) {
+    ++rank_nblocks_[rank];
+  }
+  for (int rank = 0; rank < commsize_; ++rank) {
+    fassert(
+        rank_nblocks_[rank] > 0,
+        util::Format("balance_partition: no blocks on rank {}", rank));
+  }
+
   std::vector<BlockInfoProxy> proxies;
-  GIndex<size_t, dim> procs(domain_.nprocs);
-  GIndex<size_t, dim> blocks(domain_.nblocks);
-  for (auto ib : blocks.Range()) {
+  for (auto i : gblocks.Range()) {
+    if (block_rank_[i] != commrank_) {
+      continue;
+    }
     BlockInfoProxy p;
-    p.index = domain_.nblocks * procs.GetMIdx(commrank_) + blocks.GetMIdx(ib);
+    p.index = gblocks.GetMIdx(i);
     p.globalsize = globalsize;
     p.cellsize = Vect(domain_.extent / p.globalsize.max());
     p.blocksize = domain_.blocksize;
     p.halos = domain_.halos;
-    p.isroot = (ib == 0 && isroot_);
-    p.islead = (ib == 0);
+    p.isroot = (proxies.empty() && isroot_);
+    p.islead = proxies.empty();
     proxies.push_back(p);
   }
 
   this->MakeKernels(proxies);
 
-  auto cell_to_rank = [&procs, this](MIdx w) -> int {
-    return procs.GetIdx(w / domain_.blocksize / domain_.nblocks);
+  auto cell_to_rank = [&gblocks, this](MIdx w) -> int {
+    return block_rank_[gblocks.GetIdx(w / domain_.blocksize)];
   };
   const generic::Vect<bool, dim> is_periodic(true);
 
@@ -113,267 +347,720 @@ Native<M>::Native(MPI_Comm comm, const KernelMeshFactory<M>& kf, Vars& var_)
       auto& m = k->GetMesh();
       cm_blocks.push_back({&m.GetInBlockCells(), &m.GetIndexCells()});
     }
-    tasks_ = CommManager<dim>::GetTasks(
-        cm_blocks, cell_to_rank, globalsize, is_periodic, mpi);
+    plan_ = MakePlan(
+        CommManager<dim>::GetTasks(
+            cm_blocks, cell_to_rank, globalsize, is_periodic, mpi),
+        kernels_.size());
   }
 
-  { // Create communication tasks for communication of shared blocks
+  // Shared mesh covers a box of blocks only with the default partition
+  if (!partition_) { // Create communication tasks for shared blocks
     auto& ms = *mshared_;
     std::vector<typename CommManager<dim>::Block> cm_blocks;
     cm_blocks.push_back({&ms.GetInBlockCells(), &ms.GetIndexCells()});
-    tasks_shared_ = CommManager<dim>::GetTasks(
-        cm_blocks, cell_to_rank, globalsize, is_periodic, mpi);
+    plan_shared_ = MakePlan(
+        CommManager<dim>::GetTasks(
+            cm_blocks, cell_to_rank, globalsize, is_periodic, mpi),
+        1);
   }
 
   // Set implementation of GetMpiRankFromId()
   for (auto& kernel : kernels_) {
     auto& m = kernel->GetMesh();
-    m.SetHandlerMpiRankFromId([domain=domain_](int id) -> int {
-      const MIdx global_blocks = domain.nblocks * domain.nprocs;
-      const MIdx block = GIndex<int, dim>(global_blocks).GetMIdx(id);
-      const MIdx proc = block / domain.nblocks;
-      return GIndex<int, dim>(domain.nprocs).GetIdx(proc);
+    // Block id is the flat index of block, see Flags::GetIdFromBlock()
+    m.SetHandlerMpiRankFromId([this](int id) -> int {
+      return block_rank_[id];
     });
   }
 }
 
 template <class M>
-Native<M>::~Native() = default;
+Native<M>::~Native() {
+  FreeChannels(plan_);
+  FreeChannels(plan_shared_);
+#if USEFLAG(MPI)
+  if (comm_node_ != MPI_COMM_NULL) {
+    MPI_Comm_free(&comm_node_);
+  }
+#endif
+}
 
 template <class M>
-void Native<M>::TransferHalos(
-    std::vector<std::vector<const CommRequest*>>& reqs,
-    const typename CommManager<dim>::Tasks& tasks) {
-  if (reqs.empty()) {
-    return;
-  }
-  auto& vcr = reqs.front(); // communication requests from first block
-  using Task = typename CommManager<dim>::Task;
-  using CommStencil = typename M::CommStencil;
-  using CommRequestScal = typename M::CommRequestScal;
-  using CommRequestVect = typename M::CommRequestVect;
-  std::array<std::pair<const Task*, CommStencil>, 4> taskstencils{
-      std::make_pair(&tasks.full_two, CommStencil::full_two),
-      std::make_pair(&tasks.full_one, CommStencil::full_one),
-      std::make_pair(&tasks.direct_two, CommStencil::direct_two),
-      std::make_pair(&tasks.direct_one, CommStencil::direct_one),
-  };
+auto Native<M>::GetTasks(const Tasks& tasks) -> StencilArray<const Task*> {
+  return {
+      &tasks.full_two, &tasks.full_one, &tasks.direct_two, &tasks.direct_one};
+}
 
-  for (auto& pair : taskstencils) {
-    auto& task = *pair.first;
-    auto stencil = pair.second;
+template <class M>
+auto Native<M>::MakeCellList(const std::vector<LocalCell>& cells) -> CellList {
+  CellList res;
+  res.cells.reserve(cells.size());
+  for (auto bc : cells) {
+    if (res.segments.empty() || res.segments.back().block != bc.block) {
+      res.segments.push_back({bc.block, res.cells.size(), res.cells.size()});
+    }
+    res.cells.push_back(bc.cell.raw());
+    ++res.segments.back().end;
+  }
+  return res;
+}
 
-    // indices of communication requests that have selected `stencil`
-    std::vector<size_t> vcr_indices;
-    for (size_t i = 0; i < vcr.size(); ++i) {
-      if (vcr[i]->stencil == stencil) {
-        vcr_indices.push_back(i);
+template <class M>
+auto Native<M>::MakePlan(const Tasks& tasks, size_t nblocks) const -> Plan {
+  Plan res;
+  // Returns message to `rank`, appends a new message if not found
+  auto get = [](std::vector<Message>& messages, int rank) -> Message& {
+    for (auto& msg : messages) {
+      if (msg.rank == rank) {
+        return msg;
       }
     }
-
-#if USEFLAG(MPI)
-    size_t nscal = 0; // number of scalar fields to transfer
-    for (auto i : vcr_indices) {
-      if (dynamic_cast<const CommRequestScal*>(vcr[i])) {
-        nscal += 1;
+    messages.emplace_back();
+    messages.back().rank = rank;
+    return messages.back();
+  };
+  const auto stencil_tasks = GetTasks(tasks);
+  for (size_t s = 0; s < kNumStencils; ++s) {
+    auto& task = *stencil_tasks[s];
+    auto& remote = res.remote_blocks[s];
+    remote.assign(nblocks, false);
+    for (auto& p : task.send) {
+      if (p.first == commrank_) {
+        res.local_send[s] = p.second;
+      } else if (!p.second.empty()) {
+        get(res.send, p.first).cells[s] = MakeCellList(p.second);
       }
-      if (auto crd = dynamic_cast<const CommRequestVect*>(vcr[i])) {
-        nscal += (crd->d == -1 ? dim : 1);
+    }
+    for (auto& p : task.recv) {
+      if (p.first == commrank_) {
+        res.local_recv[s] = p.second;
+      } else if (!p.second.empty()) {
+        get(res.recv, p.first).cells[s] = MakeCellList(p.second);
+        for (auto bc : p.second) {
+          remote[bc.block] = true;
+        }
       }
     }
+    fassert_equal(res.local_send[s].size(), res.local_recv[s].size());
+  }
+  return res;
+}
 
-    // Clear buffers
-    for (auto& p : tmp_recv_) {
-      auto& tmp = p.second;
-      tmp.buf.resize(0);
-      tmp.cnt = 0;
+template <class M>
+auto Native<M>::GetChannel(Plan& plan, const StencilArray<size_t>& nscal)
+    -> Channel& {
+  auto it = plan.channels.find(nscal);
+  if (it != plan.channels.end()) {
+    return it->second;
+  }
+  auto& ch = plan.channels[nscal];
+  // Returns the number of scalars in message
+  auto msgsize = [&nscal](const Message& msg) {
+    size_t res = 0;
+    for (size_t s = 0; s < kNumStencils; ++s) {
+      res += msg.cells[s].cells.size() * nscal[s];
+    }
+    return res;
+  };
+  std::vector<size_t> send_size;
+  for (auto& msg : plan.send) {
+    send_size.push_back(msgsize(msg));
+    if (GetNodeRank(msg.rank) < 0) {
+      ch.send_buf.emplace_back(send_size.back());
+    } else {
+      ch.send_buf.emplace_back();
+    }
+  }
+  for (auto& msg : plan.recv) {
+    if (GetNodeRank(msg.rank) < 0) {
+      ch.recv_buf.emplace_back(msgsize(msg));
+    } else {
+      ch.recv_buf.emplace_back();
+    }
+  }
+#if USEFLAG(MPI)
+  const auto type = sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT;
+  const int tag = 0;
+  // Returns true if messages from or to `rank` with `size` scalars
+  // have variable size
+  auto varsize = [this](int rank, size_t size) {
+    return GetNodeRank(rank) < 0 &&
+           (sparse_ || (compress_ && size * sizeof(Scal) > compress_bytes_));
+  };
+  // Returns the capacity of buffer for message of variable size
+  auto capacity = [this](size_t size) {
+    return 1 + (sparse_ ? 2 * size : size);
+  };
+  ch.send_req.resize(plan.send.size(), MPI_REQUEST_NULL);
+  for (size_t i = 0; i < plan.send.size(); ++i) {
+    auto& buf = ch.send_buf[i];
+    ch.send_varsize.push_back(varsize(plan.send[i].rank, buf.size()));
+    ch.send_zbuf.emplace_back();
+    if (ch.send_varsize[i]) {
+      buf.resize(capacity(buf.size()));
+      ch.send_zbuf[i].resize(buf.size());
+    } else {
+      MPI_Send_init(
+          buf.data(), buf.size(), type, plan.send[i].rank, tag, comm_,
+          &ch.send_req[i]);
     }
-    for (auto& p : tmp_send_) {
-      auto& tmp = p.second;
-      tmp.buf.resize(0);
-      tmp.cnt = 0;
+  }
+  ch.recv_req.resize(plan.recv.size(), MPI_REQUEST_NULL);
+  for (size_t i = 0; i < plan.recv.size(); ++i) {
+    auto& buf = ch.recv_buf[i];
+    ch.recv_varsize.push_back(varsize(plan.recv[i].rank, buf.size()));
+    ch.recv_zbuf.emplace_back();
+    if (ch.recv_varsize[i]) {
+      buf.resize(capacity(buf.size()));
+      ch.recv_zbuf[i].resize(buf.size());
+    } else {
+      MPI_Recv_init(
+          buf.data(), buf.size(), type, plan.recv[i].rank, tag, comm_,
+          &ch.recv_req[i]);
+    }
+  }
+  if (shared_memory_) {
+    InitSharedWindow(plan, ch, send_size);
+  }
+#endif
+  size_t bytes = 0;
+  for (auto* bufs : {&ch.send_buf, &ch.recv_buf}) {
+    for (auto& buf : *bufs) {
+      bytes += buf.capacity() * sizeof(Scal);
+    }
+  }
+#if USEFLAG(MPI)
+  for (auto* bufs : {&ch.send_zbuf, &ch.recv_zbuf}) {
+    for (auto& buf : *bufs) {
+      bytes += buf.capacity() * sizeof(Scal);
     }
+  }
+#endif
+  ch.mem.Set(bytes);
+  return ch;
+}
 
-    // Determine the size of receive buffer
-    for (auto& p : task.recv) {
-      auto& rank = p.first;
-      auto& cells = p.second;
-      tmp_recv_[rank].cnt += cells.size() * nscal;
+#if USEFLAG(MPI)
+template <class M>
+int Native<M>::GetNodeRank(int rank) const {
+  if (!shared_memory_ || node_rank_[rank] == MPI_UNDEFINED) {
+    return -1;
+  }
+  return node_rank_[rank];
+}
+
+template <class M>
+void Native<M>::InitSharedWindow(
+    Plan& plan, Channel& ch, const std::vector<size_t>& send_size) {
+  const int tag_done = 1;
+  const int tag_offset = 2;
+  // Offsets of messages in own window
+  std::vector<MPI_Aint> send_offset(plan.send.size(), 0);
+  size_t wsize = 0;
+  for (size_t i = 0; i < plan.send.size(); ++i) {
+    ch.send_shared.push_back(GetNodeRank(plan.send[i].rank) >= 0);
+    if (ch.send_shared.back()) {
+      send_offset[i] = wsize;
+      wsize += send_size[i];
     }
+  }
+  for (auto& msg : plan.recv) {
+    ch.recv_shared.push_back(GetNodeRank(msg.rank) >= 0);
+  }
 
-    auto type = sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT;
-    const int tag = 0;
+  // Allocate window, each rank in its own memory
+  MPI_Info info;
+  MPI_Info_create(&info);
+  MPI_Info_set(info, "alloc_shared_noncontig", "true");
+  Scal* base;
+  MPICALL(MPI_Win_allocate_shared(
+      wsize * sizeof(Scal), sizeof(Scal), info, comm_node_, &base, &ch.win));
+  MPI_Info_free(&info);
+  MPI_Win_lock_all(MPI_MODE_NOCHECK, ch.win);
+
+  // Exchange offsets of messages in windows
+  std::vector<MPI_Aint> recv_offset(plan.recv.size(), 0);
+  std::vector<MPI_Request> reqs;
+  for (size_t i = 0; i < plan.send.size(); ++i) {
+    if (ch.send_shared[i]) {
+      reqs.emplace_back();
+      MPI_Isend(
+          &send_offset[i], 1, MPI_AINT, plan.send[i].rank, tag_offset, comm_,
+          &reqs.back());
+    }
+  }
+  for (size_t i = 0; i < plan.recv.size(); ++i) {
+    if (ch.recv_shared[i]) {
+      reqs.emplace_back();
+      MPI_Irecv(
+          &recv_offset[i], 1, MPI_AINT, plan.recv[i].rank, tag_offset, comm_,
+          &reqs.back());
+    }
+  }
+  MPI_Waitall(reqs.size(), reqs.data(), MPI_STATUSES_IGNORE);
+
+  // Replace data messages with notifications
+  const auto type = sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT;
+  const int tag = 0;
+  for (size_t i = 0; i < plan.send.size(); ++i) {
+    ch.send_ptr.push_back(base + send_offset[i]);
+    ch.done_recv.push_back(MPI_REQUEST_NULL);
+    if (ch.send_shared[i]) {
+      const int rank = plan.send[i].rank;
+      MPI_Request_free(&ch.send_req[i]);
+      MPI_Send_init(nullptr, 0, type, rank, tag, comm_, &ch.send_req[i]);
+      MPI_Recv_init(
+          nullptr, 0, MPI_CHAR, rank, tag_done, comm_, &ch.done_recv[i]);
+    }
+  }
+  for (size_t i = 0; i < plan.recv.size(); ++i) {
+    ch.recv_ptr.push_back(nullptr);
+    ch.done_send.push_back(MPI_REQUEST_NULL);
+    if (ch.recv_shared[i]) {
+      const int rank = plan.recv[i].rank;
+      MPI_Aint size;
+      int disp;
+      Scal* ptr;
+      MPI_Win_shared_query(ch.win, GetNodeRank(rank), &size, &disp, &ptr);
+      ch.recv_ptr[i] = ptr + recv_offset[i];
+      MPI_Request_free(&ch.recv_req[i]);
+      MPI_Recv_init(nullptr, 0, type, rank, tag, comm_, &ch.recv_req[i]);
+      MPI_Send_init(
+          nullptr, 0, MPI_CHAR, rank, tag_done, comm_, &ch.done_send[i]);
+    }
+  }
+}
+#else
+template <class M>
+int Native<M>::GetNodeRank(int) const {
+  return -1;
+}
+#endif
 
-    // Receive
-    for (auto& p : tmp_recv_) {
-      auto& rank = p.first;
-      auto& tmp = p.second;
-      tmp.buf.resize(tmp.cnt);
-      MPI_Irecv(tmp.buf.data(), tmp.cnt, type, rank, tag, comm_, &tmp.req);
+template <class M>
+void Native<M>::FreeChannels(Plan& plan) {
+#if USEFLAG(MPI)
+  for (auto& p : plan.channels) {
+    auto& ch = p.second;
+    for (auto& req : ch.send_req) {
+      if (req != MPI_REQUEST_NULL) {
+        MPI_Request_free(&req);
+      }
     }
-    // Determine the size of send buffer
-    for (auto& p : task.send) {
-      auto& rank = p.first;
-      auto& cells = p.second;
-      tmp_send_[rank].cnt += cells.size() * nscal;
-    }
-    // Reserve send buffer
-    for (auto& p : tmp_send_) {
-      auto& tmp = p.second;
-      tmp.buf.reserve(tmp.cnt);
-    }
-    // Collect data to send
-    for (auto i : vcr_indices) {
-      if (dynamic_cast<const CommRequestScal*>(vcr[i])) {
-        std::vector<FieldCell<Scal>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestScal*>(req[i]);
-          fields.push_back(cr->field);
-        }
-        for (auto& p : task.send) {
-          auto& rank = p.first;
-          auto& cells = p.second;
-          auto& tmp = tmp_send_[rank];
-          for (auto bc : cells) {
-            tmp.buf.push_back((*fields[bc.block])[bc.cell]);
-          }
-        }
+    for (auto& req : ch.recv_req) {
+      if (req != MPI_REQUEST_NULL) {
+        MPI_Request_free(&req);
+      }
+    }
+    if (ch.win != MPI_WIN_NULL) {
+      // Wait for neighbors to read data from window
+      if (ch.done_active) {
+        MPI_Waitall(
+            ch.done_recv.size(), ch.done_recv.data(), MPI_STATUSES_IGNORE);
       }
-      if (auto crd = dynamic_cast<const CommRequestVect*>(vcr[i])) {
-        std::vector<FieldCell<Vect>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestVect*>(req[i]);
-          fields.push_back(cr->field);
+      for (auto& req : ch.done_recv) {
+        if (req != MPI_REQUEST_NULL) {
+          MPI_Request_free(&req);
         }
-        for (auto& p : task.send) {
-          auto& rank = p.first;
-          auto& cells = p.second;
-          auto& tmp = tmp_send_[rank];
-          for (auto bc : cells) {
-            if (crd->d == -1) {
-              for (size_t d = 0; d < dim; ++d) {
-                tmp.buf.push_back((*fields[bc.block])[bc.cell][d]);
-              }
-            } else {
-              tmp.buf.push_back((*fields[bc.block])[bc.cell][crd->d]);
-            }
-          }
+      }
+      for (auto& req : ch.done_send) {
+        if (req != MPI_REQUEST_NULL) {
+          MPI_Request_free(&req);
         }
       }
+      MPI_Win_unlock_all(ch.win);
+      MPI_Win_free(&ch.win);
     }
-    // Send
-    for (auto& p : tmp_send_) {
-      auto& rank = p.first;
-      auto& tmp = p.second;
-      tmp.buf.resize(tmp.cnt);
-      MPI_Isend(tmp.buf.data(), tmp.cnt, type, rank, tag, comm_, &tmp.req);
-    }
-    // Wait for send and receive
-    for (auto& p : tmp_send_) {
-      MPI_Wait(&p.second.req, MPI_STATUS_IGNORE);
-    }
-    for (auto& p : tmp_recv_) {
-      MPI_Wait(&p.second.req, MPI_STATUS_IGNORE);
-    }
-    // Copy received data to fields, use `cnt` for position
-    for (auto& p : tmp_recv_) {
-      p.second.cnt = 0;
-    }
-    for (auto i : vcr_indices) {
-      if (dynamic_cast<const CommRequestScal*>(vcr[i])) {
-        std::vector<FieldCell<Scal>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestScal*>(req[i]);
-          fields.push_back(cr->field);
-        }
-        for (auto& p : task.recv) {
-          auto& rank = p.first;
-          auto& cells = p.second;
-          auto& tmp = tmp_recv_[rank];
-          for (auto bc : cells) {
-            (*fields[bc.block])[bc.cell] = tmp.buf[tmp.cnt++];
-          }
-        }
+  }
+#endif
+  plan.channels.clear();
+}
+
+template <class M>
+auto Native<M>::Pack(const FieldReq& fr, const CellList& list, Scal* buf)
+    -> Scal* {
+  for (auto& seg : list.segments) {
+    const Scal* data = fr.data[seg.block] + fr.offset;
+    for (size_t i = seg.begin; i < seg.end; ++i) {
+      const Scal* src = data + list.cells[i] * fr.stride;
+      for (size_t k = 0; k < fr.size; ++k) {
+        *buf++ = src[k];
       }
-      if (auto crd = dynamic_cast<const CommRequestVect*>(vcr[i])) {
-        std::vector<FieldCell<Vect>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestVect*>(req[i]);
-          fields.push_back(cr->field);
-        }
-        for (auto& p : task.recv) {
-          auto& rank = p.first;
-          auto& cells = p.second;
-          auto& tmp = tmp_recv_[rank];
-          for (auto bc : cells) {
-            if (crd->d == -1) {
-              for (size_t d = 0; d < dim; ++d) {
-                (*fields[bc.block])[bc.cell][d] = tmp.buf[tmp.cnt++];
-              }
-            } else {
-              (*fields[bc.block])[bc.cell][crd->d] = tmp.buf[tmp.cnt++];
-            }
-          }
+    }
+  }
+  return buf;
+}
+
+template <class M>
+auto Native<M>::Unpack(
+    const FieldReq& fr, const CellList& list, const Scal* buf) -> const Scal* {
+  for (auto& seg : list.segments) {
+    Scal* data = fr.data[seg.block] + fr.offset;
+    for (size_t i = seg.begin; i < seg.end; ++i) {
+      Scal* dst = data + list.cells[i] * fr.stride;
+      for (size_t k = 0; k < fr.size; ++k) {
+        dst[k] = *buf++;
+      }
+    }
+  }
+  return buf;
+}
+
+template <class M>
+auto Native<M>::PackSparse(const FieldReq& fr, const CellList& list, Scal* buf)
+    -> Scal* {
+  for (auto& seg : list.segments) {
+    const Scal* data = fr.data[seg.block] + fr.offset;
+    const Scal* first = data + list.cells[seg.begin] * fr.stride;
+    bool uniform = true;
+    for (size_t i = seg.begin + 1; i < seg.end && uniform; ++i) {
+      const Scal* src = data + list.cells[i] * fr.stride;
+      for (size_t k = 0; k < fr.size; ++k) {
+        uniform = uniform && src[k] == first[k];
+      }
+    }
+    const size_t ncells = seg.end - seg.begin;
+    if (uniform && ncells > 1) {
+      *buf++ = ncells;
+      for (size_t k = 0; k < fr.size; ++k) {
+        *buf++ = first[k];
+      }
+    } else {
+      *buf++ = -Scal(ncells);
+      for (size_t i = seg.begin; i < seg.end; ++i) {
+        const Scal* src = data + list.cells[i] * fr.stride;
+        for (size_t k = 0; k < fr.size; ++k) {
+          *buf++ = src[k];
         }
       }
     }
+  }
+  return buf;
+}
+
+template <class M>
+auto Native<M>::UnpackSparse(
+    const FieldReq& fr, const CellList& list, const Scal* buf) -> const Scal* {
+  // Segments of the sender may differ from segments of the receiver,
+  // so the headers are read independently of `list.segments`.
+  size_t left = 0; // number of cells left in current segment of sender
+  bool uniform = false;
+  for (auto& seg : list.segments) {
+    Scal* data = fr.data[seg.block] + fr.offset;
+    for (size_t i = seg.begin; i < seg.end; ++i) {
+      if (!left) {
+        const Scal header = *buf++;
+        uniform = (header > 0);
+        left = std::abs(header);
+      }
+      Scal* dst = data + list.cells[i] * fr.stride;
+      for (size_t k = 0; k < fr.size; ++k) {
+        dst[k] = buf[k];
+      }
+      --left;
+      if (!uniform || !left) {
+        buf += fr.size;
+      }
+    }
+  }
+  return buf;
+}
+
+template <class M>
+void Native<M>::CopyLocal(
+    const FieldReq& fr, const std::vector<LocalCell>& send,
+    const std::vector<LocalCell>& recv) {
+  for (size_t ic = 0; ic < send.size(); ++ic) {
+    const auto s = send[ic];
+    const auto r = recv[ic];
+    const Scal* src = fr.data[s.block] + s.cell.raw() * fr.stride + fr.offset;
+    Scal* dst = fr.data[r.block] + r.cell.raw() * fr.stride + fr.offset;
+    for (size_t k = 0; k < fr.size; ++k) {
+      dst[k] = src[k];
+    }
+  }
+}
+
+template <class M>
+void Native<M>::StartTransfer(
+    const std::vector<std::vector<CommRequest*>>& reqs, Plan& plan) {
+  auto& tr = transfer_;
+  tr = Transfer();
+  if (reqs.empty() || reqs.front().empty()) {
+    return;
+  }
+  auto& vcr = reqs.front(); // communication requests from first block
+  tr.plan = &plan;
+
+  // Collect fields from all blocks. The requests themselves may be cleared
+  // before the transfer is finished, so only the pointers to data are kept.
+  StencilArray<size_t> nscal{}; // number of scalars per cell for each stencil
+  const auto stencils = GetStencils();
+  for (size_t i = 0; i < vcr.size(); ++i) {
+    size_t s = 0;
+    while (s < kNumStencils && stencils[s] != vcr[i]->stencil) {
+      ++s;
+    }
+    fassert(s < kNumStencils, "Unknown stencil");
+    tr.fields[s].emplace_back();
+    auto& fr = tr.fields[s].back();
+    fr.stride = vcr[i]->GetStride();
+    fr.size = vcr[i]->GetSize();
+    fr.offset = (fr.size == fr.stride ? 0 : vcr[i]->GetIndex());
+#if USEFLAG(MPI)
+    fr.tol = (vcr[i]->lossy ? compress_tol_ : 0);
 #else
-    // Exchange data between blocks.
-    for (auto i : vcr_indices) {
-      if (dynamic_cast<const CommRequestScal*>(vcr[i])) {
-        std::vector<FieldCell<Scal>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestScal*>(req[i]);
-          fields.push_back(cr->field);
-        }
-        auto& send = task.send.at(0);
-        auto& recv = task.recv.at(0);
-        fassert_equal(send.size(), recv.size());
-        for (size_t ic = 0; ic < send.size(); ++ic) {
-          (*fields[recv[ic].block])[recv[ic].cell] =
-              (*fields[send[ic].block])[send[ic].cell];
-        }
+    fr.tol = 0;
+#endif
+    for (auto& req : reqs) {
+      fr.data.push_back(req[i]->GetBasePtr());
+    }
+    nscal[s] += fr.size;
+  }
+
+  auto& ch = GetChannel(plan, nscal);
+  tr.channel = &ch;
+
+#if USEFLAG(MPI)
+  const auto type = sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT;
+  const int tag = 0;
+  for (size_t i = 0; i < plan.recv.size(); ++i) {
+    if (ch.recv_varsize[i]) {
+      auto& zbuf = ch.recv_zbuf[i];
+      MPI_Irecv(
+          zbuf.data(), zbuf.size(), type, plan.recv[i].rank, tag, comm_,
+          &ch.recv_req[i]);
+    } else {
+      MPI_Start(&ch.recv_req[i]);
+    }
+  }
+  if (ch.win != MPI_WIN_NULL) {
+    // Wait until neighbors have read the previous data from window
+    if (ch.done_active) {
+      auto trace = P::TraceScope("mpi_wait");
+      MPI_Waitall(
+          ch.done_recv.size(), ch.done_recv.data(), MPI_STATUSES_IGNORE);
+    }
+    for (auto& req : ch.done_recv) {
+      if (req != MPI_REQUEST_NULL) {
+        MPI_Start(&req);
       }
-      if (auto crd = dynamic_cast<const CommRequestVect*>(vcr[i])) {
-        std::vector<FieldCell<Vect>*> fields;
-        for (auto& req : reqs) {
-          const auto* cr = static_cast<const CommRequestVect*>(req[i]);
-          fields.push_back(cr->field);
-        }
-        auto& send = task.send.at(0);
-        auto& recv = task.recv.at(0);
-        fassert_equal(send.size(), recv.size());
-        for (size_t ic = 0; ic < send.size(); ++ic) {
-          const auto d = crd->d;
-          if (d == -1) {
-            (*fields[recv[ic].block])[recv[ic].cell] =
-                (*fields[send[ic].block])[send[ic].cell];
-          } else {
-            fassert(0 <= d && d < int(M::dim));
-            (*fields[recv[ic].block])[recv[ic].cell][d] =
-                (*fields[send[ic].block])[send[ic].cell][d];
+    }
+    ch.done_active = true;
+  }
+  for (size_t i = 0; i < plan.send.size(); ++i) {
+    const bool shared = ch.win != MPI_WIN_NULL && ch.send_shared[i];
+    const bool varsize = ch.send_varsize[i];
+    Scal* const begin = shared ? ch.send_ptr[i]
+                               : ch.send_buf[i].data() + (varsize ? 1 : 0);
+    Scal* buf = begin;
+    // Appends section of data up to `buf` compressed with tolerance `tol`
+    sections_.clear();
+    auto add_section = [&](Scal tol) {
+      const size_t end = buf - begin;
+      if (!sections_.empty() && sections_.back().first == end) {
+        return;
+      }
+      if (!sections_.empty() && sections_.back().second == tol) {
+        sections_.back().first = end;
+      } else {
+        sections_.emplace_back(end, tol);
+      }
+    };
+    for (size_t s = 0; s < kNumStencils; ++s) {
+      for (auto& fr : tr.fields[s]) {
+        auto& cells = plan.send[i].cells[s];
+        buf = (varsize && sparse_ ? PackSparse(fr, cells, buf)
+                                  : Pack(fr, cells, buf));
+        add_section(fr.tol);
+      }
+    }
+    if (shared) {
+      MPI_Win_sync(ch.win);
+    }
+    if (varsize) {
+      const int rank = plan.send[i].rank;
+      const size_t size = buf - begin;
+      auto& zbuf = ch.send_zbuf[i];
+      size_t zsize = size;
+      if (compress_ && size > 0 && size * sizeof(Scal) > compress_bytes_) {
+        // Encode sections one after another, so that only fields
+        // requested as lossy are compressed with a non-zero tolerance
+        zsize = 0;
+        size_t start = 0;
+        for (auto& sec : sections_) {
+          zsize += compression::EncodeRuns(
+              begin + start, sec.first - start, sec.second,
+              zbuf.data() + 1 + zsize, size - 1 - zsize);
+          if (zsize >= size) {
+            break;
           }
+          start = sec.first;
         }
       }
+      // Send encoded data if shorter than the original
+      if (zsize < size) {
+        zbuf[0] = 1;
+        MPI_Isend(
+            zbuf.data(), zsize + 1, type, rank, tag, comm_, &ch.send_req[i]);
+      } else {
+        ch.send_buf[i][0] = 0;
+        MPI_Isend(
+            ch.send_buf[i].data(), size + 1, type, rank, tag, comm_,
+            &ch.send_req[i]);
+      }
+    } else {
+      MPI_Start(&ch.send_req[i]);
+    }
+  }
+#endif
+
+  // Exchange data between blocks on current rank.
+  for (size_t s = 0; s < kNumStencils; ++s) {
+    for (auto& fr : tr.fields[s]) {
+      CopyLocal(fr, plan.local_send[s], plan.local_recv[s]);
+    }
+  }
+}
+
+#if USEFLAG(MPI)
+template <class M>
+void Native<M>::UnpackMessage(size_t i, const MPI_Status& status) {
+  auto& tr = transfer_;
+  auto& plan = *tr.plan;
+  auto& ch = *tr.channel;
+  const auto type = sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT;
+  const bool shared = ch.win != MPI_WIN_NULL && ch.recv_shared[i];
+  if (shared) {
+    MPI_Win_sync(ch.win);
+  }
+  const Scal* buf = shared ? ch.recv_ptr[i] : ch.recv_buf[i].data();
+  const bool varsize = ch.recv_varsize[i];
+  if (varsize) {
+    auto& zbuf = ch.recv_zbuf[i];
+    int size;
+    MPI_Get_count(&status, type, &size);
+    if (zbuf[0] == 1) { // encoded data
+      compression::DecodeRuns(
+          zbuf.data() + 1, size - 1, ch.recv_buf[i].data());
+    } else {
+      buf = zbuf.data() + 1;
+    }
+  }
+  for (size_t s = 0; s < kNumStencils; ++s) {
+    for (auto& fr : tr.fields[s]) {
+      auto& cells = plan.recv[i].cells[s];
+      buf = (varsize && sparse_ ? UnpackSparse(fr, cells, buf)
+                                : Unpack(fr, cells, buf));
+    }
+  }
+  if (shared) {
+    MPI_Start(&ch.done_send[i]);
+  }
+}
+
+template <class M>
+void Native<M>::FinishSends() {
+  auto trace = P::TraceScope("mpi_wait");
+  auto& ch = *transfer_.channel;
+  if (!ch.send_req.empty()) {
+    MPI_Waitall(ch.send_req.size(), ch.send_req.data(), MPI_STATUSES_IGNORE);
+  }
+  if (!ch.done_send.empty()) {
+    MPI_Waitall(
+        ch.done_send.size(), ch.done_send.data(), MPI_STATUSES_IGNORE);
+  }
+}
+#endif
+
+template <class M>
+void Native<M>::FinishTransfer() {
+  auto& tr = transfer_;
+  if (!tr.plan) {
+    return;
+  }
+#if USEFLAG(MPI)
+  auto& ch = *tr.channel;
+  for (size_t i = 0; i < ch.recv_req.size(); ++i) {
+    MPI_Status status;
+    {
+      auto trace = P::TraceScope("mpi_wait");
+      MPI_Wait(&ch.recv_req[i], &status);
     }
+    UnpackMessage(i, status);
+  }
+  FinishSends();
 #endif
+  tr = Transfer();
+}
+
+template <class M>
+auto Native<M>::FinishTransferSome() -> std::vector<size_t> {
+  auto& tr = transfer_;
+  if (!tr.plan) {
+    return {};
   }
+  std::vector<size_t> res;
+#if USEFLAG(MPI)
+  auto& ch = *tr.channel;
+  std::vector<int> indices(ch.recv_req.size());
+  std::vector<MPI_Status> statuses(ch.recv_req.size());
+  while (res.empty()) {
+    int count = MPI_UNDEFINED;
+    if (!ch.recv_req.empty()) {
+      auto trace = P::TraceScope("mpi_wait");
+      MPI_Waitsome(
+          ch.recv_req.size(), ch.recv_req.data(), &count, indices.data(),
+          statuses.data());
+    }
+    if (count == MPI_UNDEFINED) { // all messages received
+      FinishSends();
+      tr = Transfer();
+      break;
+    }
+    for (int k = 0; k < count; ++k) {
+      const size_t i = indices[k];
+      UnpackMessage(i, statuses[k]);
+      for (auto b : message_blocks_[i]) {
+        if (--pending_messages_[b] == 0) {
+          res.push_back(b);
+        }
+      }
+    }
+  }
+#else
+  FinishTransfer();
+#endif
+  return res;
+}
+template <class M>
+void Native<M>::TransferHalos(
+    const std::vector<std::vector<CommRequest*>>& reqs, Plan& plan) {
+  StartTransfer(reqs, plan);
+  FinishTransfer();
 }
 
 template <class M>
 auto Native<M>::TransferHalos(bool inner) -> std::vector<size_t> {
   if (!inner) {
-    return {};
+    // Wait for communication started with inner=true
+    FinishTransfer();
+    return std::move(halo_blocks_);
   }
+  halo_blocks_.clear();
 
   // Exchange halos of shared mesh
   {
-    std::vector<std::vector<const CommRequest*>> reqs;
+    std::vector<std::vector<CommRequest*>> reqs;
     reqs.emplace_back();
+    fassert(
+        !partition_ || mshared_->GetComm().empty(),
+        "Communication on shared mesh is not supported with "
+        "balance_partition");
     for (auto& cr : mshared_->GetComm()) {
       reqs.back().push_back(cr.get());
     }
-    TransferHalos(reqs, tasks_shared_);
+    TransferHalos(reqs, plan_shared_);
   }
 
   std::vector<size_t> bb(kernels_.size());
@@ -384,15 +1071,74 @@ auto Native<M>::TransferHalos(bool inner) -> std::vector<size_t> {
   }
 
   // Exchange halos of blocks
-  std::vector<std::vector<const CommRequest*>> reqs;
+  std::vector<std::vector<CommRequest*>> reqs;
   for (auto& k : kernels_) {
     reqs.emplace_back();
     for (auto& cr : k->GetMesh().GetComm()) {
       reqs.back().push_back(cr.get());
     }
   }
-  TransferHalos(reqs, tasks_);
+  StartTransfer(reqs, plan_);
 
+  if (!overlap_) {
+    FinishTransfer();
+    return bb;
+  }
+
+  // Select blocks that need halos from other ranks,
+  // these will wait until the communication is finished.
+  std::vector<bool> wait(kernels_.size(), false);
+  for (size_t s = 0; s < kNumStencils; ++s) {
+    if (!transfer_.fields[s].empty()) {
+      auto& remote = plan_.remote_blocks[s];
+      for (size_t b = 0; b < kernels_.size(); ++b) {
+        wait[b] = wait[b] || remote[b];
+      }
+    }
+  }
+  std::vector<size_t> bbi;
+  for (auto b : bb) {
+    (wait[b] ? halo_blocks_ : bbi).push_back(b);
+  }
+
+  if (overlap_ >= 2) {
+    // Count messages for each block, used by TransferHalosNext()
+    pending_messages_.assign(kernels_.size(), 0);
+    message_blocks_.clear();
+    for (auto& msg : plan_.recv) {
+      message_blocks_.emplace_back();
+      auto& blocks = message_blocks_.back();
+      for (size_t s = 0; s < kNumStencils; ++s) {
+        if (!transfer_.fields[s].empty()) {
+          for (auto& seg : msg.cells[s].segments) {
+            blocks.push_back(seg.block);
+          }
+        }
+      }
+      std::sort(blocks.begin(), blocks.end());
+      blocks.erase(std::unique(blocks.begin(), blocks.end()), blocks.end());
+      for (auto b : blocks) {
+        ++pending_messages_[b];
+      }
+    }
+  }
+  return bbi;
+}
+
+template <class M>
+auto Native<M>::TransferHalosNext() -> std::vector<size_t> {
+  if (overlap_ < 2) {
+    return {};
+  }
+  auto bb = FinishTransferSome();
+  // Remove blocks from those returned by TransferHalos(false)
+  std::vector<size_t> rest;
+  for (auto b : halo_blocks_) {
+    if (pending_messages_[b]) {
+      rest.push_back(b);
+    }
+  }
+  halo_blocks_ = std::move(rest);
   return bb;
 }
 
@@ -490,8 +1236,7 @@ void Native<M>::Scatter(const std::vector<size_t>& bb) {
           for (int rank = 0; rank < commsize_; ++rank) {
             dis[rank] = buf.size();
             sizes_dis[rank] = sizes_buf.size();
-            // XXX assuming the same number of blocks on all ranks
-            for (size_t k = 0; k < bb.size(); ++k) {
+            for (size_t k = 0; k < rank_nblocks_[rank]; ++k) {
               auto& v = (*req.first)[i];
               buf.insert(buf.end(), v.begin(), v.end());
               sizes_buf.push_back(v.size());
@@ -560,6 +1305,7 @@ void Native<M>::Scatter(const std::vector<size_t>& bb) {
 template <class M>
 void Native<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
   using OpScal = typename UReduce<Scal>::OpS;
+  using OpSumV = typename UReduce<Scal>::OpSumV;
   using OpScalInt = typename UReduce<Scal>::OpSI;
   using OpConcat = typename UReduce<Scal>::OpCat;
 
@@ -590,7 +1336,10 @@ void Native<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
     MPI_Datatype mt = (sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT);
 
     // Reduce over ranks
-    MPI_Allreduce(MPI_IN_PLACE, &buf, 1, mt, mpiop, comm_);
+    {
+      auto trace = P::TraceScope("mpi_allreduce");
+      MPI_Allreduce(MPI_IN_PLACE, &buf, 1, mt, mpiop, comm_);
+    }
 #endif
 
     // Write results to all blocks on current rank
@@ -600,6 +1349,32 @@ void Native<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
     }
     return;
   }
+  if (auto* first = dynamic_cast<OpSumV*>(firstbase)) {
+    auto buf = first->Neutral(); // result
+
+    // Reduce over blocks on current rank
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Append(buf);
+    }
+
+#if USEFLAG(MPI)
+    MPI_Datatype mt = (sizeof(Scal) == 8 ? MPI_DOUBLE : MPI_FLOAT);
+
+    // Reduce over ranks
+    {
+      auto trace = P::TraceScope("mpi_allreduce");
+      MPI_Allreduce(MPI_IN_PLACE, buf.data(), buf.size(), mt, MPI_SUM, comm_);
+    }
+#endif
+
+    // Write results to all blocks on current rank
+    for (auto otherbase : blocks) {
+      auto* other = dynamic_cast<OpSumV*>(otherbase);
+      other->Set(buf);
+    }
+    return;
+  }
   if (auto* first = dynamic_cast<OpScalInt*>(firstbase)) {
     auto buf = first->Neutral(); // result
 
@@ -622,7 +1397,10 @@ void Native<M>::ReduceSingleRequest(const std::vector<RedOp*>& blocks) {
     MPI_Datatype mt = (sizeof(Scal) == 8 ? MPI_DOUBLE_INT : MPI_FLOAT_INT);
 
     // Reduce over all ranks
-    MPI_Allreduce(MPI_IN_PLACE, &buf, 1, mt, mpiop, comm_);
+    {
+      auto trace = P::TraceScope("mpi_allreduce");
+      MPI_Allreduce(MPI_IN_PLACE, &buf, 1, mt, mpiop, comm_);
+    }
 #endif
 
     // Write results to all blocks on current rank
@@ -148,6 +148,31 @@ class UReduce {
   template <class T>
   using OpVT = OpT<std::vector<T>>;
 
+  // Elementwise sum of std::vector<Scal> of equal size.
+  // Result on all blocks.
+  class OpSumV : public OpVT<Scal> {
+   public:
+    using P = OpVT<Scal>;
+    using P::P;
+    using P::Append;
+    using P::Set;
+    std::vector<Scal> Neutral() const override {
+      return {};
+    }
+
+   protected:
+    void Append(std::vector<Scal>& a, const std::vector<Scal>& v)
+        const override {
+      if (a.empty()) {
+        a.resize(v.size(), 0);
+      }
+      fassert_equal(a.size(), v.size());
+      for (size_t i = 0; i < v.size(); ++i) {
+        a[i] += v[i];
+      }
+    }
+  };
+
   // Concatenation of std::vector<char>
   // Result only on root block.
   class OpCat : public OpVT<char> {
@@ -357,6 +382,12 @@ class UReduce {
   void Clear() {
     reqs_.clear();
   }
+  // Returns requests and clears the list
+  std::vector<std::unique_ptr<Op>> Release() {
+    auto res = std::move(reqs_);
+    reqs_.clear();
+    return res;
+  }
 
   template <class T>
   static std::unique_ptr<OpCatT<T>> Make(
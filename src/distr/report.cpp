@@ -104,3 +104,42 @@ void ParseReport(
   AccumulateTimeFromLeaves(root);
   PrintTree(root, out);
 }
+
+void ReportCounters(
+    const std::map<std::string, PerfCounters::Values>& counters,
+    const PerfCounters& perf, std::ostream& out) {
+  if (!perf.IsAvailable()) {
+    out << "counters: unavailable\n";
+    return;
+  }
+  using Values = PerfCounters::Values;
+  auto print = [&](const std::string& name, const Values& v) {
+    out << name << " [";
+    for (size_t i = 0; i < v.size(); ++i) {
+      out << (i ? ", " : "") << PerfCounters::GetName(i) << "=";
+      if (perf.IsAvailable(i)) {
+        out << util::Format("{:.3e}", double(v[i]));
+      } else {
+        out << '-';
+      }
+    }
+    const auto cyc = PerfCounters::kCycles;
+    const auto ins = PerfCounters::kInstructions;
+    out << ", ipc=";
+    if (perf.IsAvailable(cyc) && perf.IsAvailable(ins) && v[cyc] > 0) {
+      out << util::Format("{:.2f}", double(v[ins]) / v[cyc]);
+    } else {
+      out << '-';
+    }
+    out << "]\n";
+  };
+  Values total{};
+  out << "counters:\n";
+  for (const auto& p : counters) {
+    print(p.first.empty() ? "other" : p.first, p.second);
+    for (size_t i = 0; i < total.size(); ++i) {
+      total[i] += p.second[i];
+    }
+  }
+  print("all", total);
+}
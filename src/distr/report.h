@@ -5,9 +5,19 @@
 #include <map>
 #include <string>
 
+#include "util/perfcounters.h"
+
 // timings: map from stage name to timing, stage name composed from
 //   arguments of Sem() separated by ' --> '
 // Example:
 //   "fluid --> step --> init" : 0.1
 void ParseReport(
     const std::map<std::string, double>& timings, std::ostream& out);
+
+// Writes hardware counters of each stage and their total,
+// one line per stage, unavailable counters as '-'.
+// counters: map from stage name to counters
+// perf: counters to check which are available
+void ReportCounters(
+    const std::map<std::string, PerfCounters::Values>& counters,
+    const PerfCounters& perf, std::ostream& out);
@@ -12,31 +12,45 @@
 
 #include "idx.h"
 #include "range.h"
+#include "util/bufferpool.h"
 #include "util/logger.h"
+#include "util/memtrack.h"
 
 // Partial implementation of std::vector<T> without specialization for T=bool.
+// Allocated memory is attributed to the current owner of memtrack
+// and taken from BufferPool.
 template <class T>
 class Vector {
  public:
   Vector() = default;
   ~Vector() {
-    if (owning_) {
-      delete[] data_;
-    }
+    Free();
   }
   explicit Vector(size_t size)
-      : size_(size), data_(new T[size]), owning_(true) {}
+      : size_(size)
+      , tag_(memtrack::GetCurrent())
+      , data_(Allocate(size))
+      , owning_(true) {}
   Vector(T* data, size_t size) : size_(size), data_(data), owning_(false) {}
   Vector(size_t size, const T& value)
-      : size_(size), data_(new T[size]), owning_(true) {
+      : size_(size)
+      , tag_(memtrack::GetCurrent())
+      , data_(Allocate(size))
+      , owning_(true) {
     std::fill(data_, data_ + size_, value);
   }
   Vector(const Vector& other)
-      : size_(other.size_), data_(new T[other.size_]), owning_(true) {
+      : size_(other.size_)
+      , tag_(memtrack::GetCurrent())
+      , data_(Allocate(other.size_))
+      , owning_(true) {
     std::copy(other.data_, other.data_ + size_, data_);
   }
   Vector(Vector&& other)
-      : size_(other.size_), data_(other.data_), owning_(other.owning_) {
+      : size_(other.size_)
+      , tag_(other.tag_)
+      , data_(other.data_)
+      , owning_(other.owning_) {
     other.size_ = 0;
     other.data_ = nullptr;
     other.owning_ = true;
@@ -46,12 +60,11 @@ class Vector {
     return *this;
   }
   Vector& operator=(Vector&& other) {
-    if (owning_) {
-      delete[] data_;
-    }
+    Free();
     size_ = other.size_;
     data_ = other.data_;
     owning_ = other.owning_;
+    tag_ = other.tag_;
     other.size_ = 0;
     other.data_ = nullptr;
     other.owning_ = true;
@@ -85,7 +98,29 @@ class Vector {
   }
 
  private:
+  // Allocates memory attributed to owner tag_,
+  // elements are default-initialized as with new T[size]
+  T* Allocate(size_t size) {
+    memtrack::Allocate(tag_, size * sizeof(T));
+    auto& pool = BufferPool::GetInstance();
+    T* ptr = static_cast<T*>(pool.Allocate(size * sizeof(T)));
+    for (size_t i = 0; i < size; ++i) {
+      new (ptr + i) T;
+    }
+    return ptr;
+  }
+  void Free() {
+    if (owning_ && data_) {
+      memtrack::Free(tag_, size_ * sizeof(T));
+      for (size_t i = 0; i < size_; ++i) {
+        data_[i].~T();
+      }
+      BufferPool::GetInstance().Free(data_, size_ * sizeof(T));
+    }
+  }
+
   size_t size_ = 0;
+  memtrack::Tag tag_ = 0; // owner of allocated memory
   T* data_ = nullptr;
   bool owning_ = true; // true if memory is managed by the object
 };
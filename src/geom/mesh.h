@@ -667,6 +667,8 @@ class MeshCartesian {
     // that Vect::value_type is Scal and must not be changed
     virtual Scal* GetBasePtr() = 0;
     CommStencil stencil = CommStencil::full_two;
+    // Allow error-bounded compression of halos (native_compress_tol)
+    bool lossy = false;
   };
   // FieldCell<Scal>
   struct CommRequestScal : public CommRequest {
@@ -714,6 +716,10 @@ class MeshCartesian {
       CommStencil stencil = CommStencil::full_two);
   void Comm(
       FieldCell<Vect>* field, CommStencil stencil = CommStencil::full_two);
+  // Same as Comm() but halos may be compressed with a bounded error,
+  // intended for fields like volume fraction.
+  void CommLossy(
+      FieldCell<Scal>* field, CommStencil stencil = CommStencil::full_two);
   const std::vector<std::unique_ptr<CommRequest>>& GetComm() const;
   void ClearComm();
 
@@ -742,6 +748,10 @@ class MeshCartesian {
   void Reduce(Scal* buf, ReductionType::Min);
   void Reduce(std::pair<Scal, int>* buf, ReductionType::MaxLoc);
   void Reduce(std::pair<Scal, int>* buf, ReductionType::MinLoc);
+  // Elementwise sum, buf must have the same size on all blocks
+  void Reduce(std::vector<Scal>* buf, ReductionType::Sum) {
+    Reduce(std::make_unique<typename UReduce<Scal>::OpSumV>(buf));
+  }
   template <class T>
   void Reduce(std::vector<T>* buf, ReductionType::Concat) {
     Reduce(std::make_unique<typename UReduce<Scal>::template OpCatT<T>>(buf));
@@ -751,6 +761,21 @@ class MeshCartesian {
     Reduce(std::make_unique<typename UReduce<Scal>::template OpCatVT<T>>(buf));
   }
   void ClearReduce();
+  // Deferred reduction: started at the end of current stage without waiting
+  // and completed at the end of the stage that calls WaitReduce(),
+  // so the result is available from the next stage.
+  void ReduceDeferred(Scal* buf, ReductionType::Sum);
+  void ReduceDeferred(Scal* buf, ReductionType::Prod);
+  void ReduceDeferred(Scal* buf, ReductionType::Max);
+  void ReduceDeferred(Scal* buf, ReductionType::Min);
+  void ReduceDeferred(std::pair<Scal, int>* buf, ReductionType::MaxLoc);
+  void ReduceDeferred(std::pair<Scal, int>* buf, ReductionType::MinLoc);
+  // Returns deferred reductions requested since the last call
+  std::vector<std::unique_ptr<Op>> ReleaseReduceDeferred();
+  // Requests to complete all deferred reductions at the end of current stage
+  void WaitReduce();
+  bool GetWaitReduce() const;
+  void ClearWaitReduce();
   void ReduceToLead(std::unique_ptr<Op>&& o);
   template <class T>
   void GatherToLead(std::vector<T>* buf) {
@@ -795,7 +820,9 @@ class MeshCartesian {
   void Scatter(const ScatterRequest& req);
   const std::vector<ScatterRequest>& GetScatter() const;
   void ClearScatter();
-  // Request timer report to file s
+  // Request timer report to file s.
+  // Only the request of the first block on each rank is checked,
+  // the report is written if any rank requested it.
   void TimerReport(const std::string& s) {
     timer_report_path_ = s;
   }
@@ -32,6 +32,8 @@ struct MeshCartesian<_Scal, _dim>::Imp {
   std::vector<std::pair<std::unique_ptr<CommRequest>, std::string>> dump;
   UReduce<Scal> reduce;
   UReduce<Scal> reduce_lead;
+  UReduce<Scal> reduce_deferred;
+  bool wait_reduce = false;
   std::vector<std::unique_ptr<typename UReduce<Scal>::Op>> bcast;
   std::vector<std::unique_ptr<typename UReduce<Scal>::Op>> bcast_lead;
   std::vector<ScatterRequest> scatter;
@@ -230,6 +232,14 @@ void MeshCartesian<Scal, dim>::Comm(FieldCell<Vect>* f, CommStencil stencil) {
   Comm(f, -1, stencil);
 }
 template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::CommLossy(
+    FieldCell<Scal>* f, CommStencil stencil) {
+  fassert_equal(f->size(), indexc_.size());
+  auto r = std::make_unique<CommRequestScal>(f, stencil);
+  r->lossy = true;
+  Comm(std::move(r));
+}
+template <class Scal, size_t dim>
 void MeshCartesian<Scal, dim>::Dump(const FieldCell<Scal>* f, std::string n) {
   auto ff = const_cast<FieldCell<Scal>*>(f);
   imp->dump.emplace_back(
@@ -310,6 +320,55 @@ void MeshCartesian<Scal, dim>::ClearReduce() {
   imp->reduce.Clear();
 }
 template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    Scal* buf, ReductionType::Sum) {
+  imp->reduce_deferred.Add(buf, "sum");
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    Scal* buf, ReductionType::Prod) {
+  imp->reduce_deferred.Add(buf, "prod");
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    Scal* buf, ReductionType::Max) {
+  imp->reduce_deferred.Add(buf, "max");
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    Scal* buf, ReductionType::Min) {
+  imp->reduce_deferred.Add(buf, "min");
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    std::pair<Scal, int>* buf, ReductionType::MaxLoc) {
+  imp->reduce_deferred.Add(
+      std::make_unique<typename UReduce<Scal>::OpMaxloc>(buf));
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ReduceDeferred(
+    std::pair<Scal, int>* buf, ReductionType::MinLoc) {
+  imp->reduce_deferred.Add(
+      std::make_unique<typename UReduce<Scal>::OpMinloc>(buf));
+}
+template <class Scal, size_t dim>
+auto MeshCartesian<Scal, dim>::ReleaseReduceDeferred()
+    -> std::vector<std::unique_ptr<Op>> {
+  return imp->reduce_deferred.Release();
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::WaitReduce() {
+  imp->wait_reduce = true;
+}
+template <class Scal, size_t dim>
+bool MeshCartesian<Scal, dim>::GetWaitReduce() const {
+  return imp->wait_reduce;
+}
+template <class Scal, size_t dim>
+void MeshCartesian<Scal, dim>::ClearWaitReduce() {
+  imp->wait_reduce = false;
+}
+template <class Scal, size_t dim>
 void MeshCartesian<Scal, dim>::ReduceToLead(
     std::unique_ptr<typename UReduce<Scal>::Op>&& o) {
   imp->reduce_lead.Add(std::move(o));
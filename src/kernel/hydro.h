@@ -152,6 +152,8 @@ class Hydro : public KernelMeshPar<M_, GPar<M_>> {
   void ReportStepParticles();
   void ReportStepElectro();
   void ReportSysinfo(std::ostream& out);
+  // Reports memory of fields and buffers for each owner of memtrack
+  void ReportMemory(std::ostream& out);
   void ReportIter();
   // Issue sem.LoopBreak if abort conditions met
   void CheckAbort(Sem& sem, Scal& nabort);
@@ -244,6 +246,44 @@ class Hydro : public KernelMeshPar<M_, GPar<M_>> {
   Dumper dmptrep_; // dumper for timer report
   Dumper bubgen_;
   std::unique_ptr<Events> events_; // events from var
+  // Variables read in every step, resolved by key only once
+  struct VarHandles {
+    VarHandles(const Vars& var);
+    Vars::Handle<double> tmax;
+    Vars::Handle<int> max_step;
+    Vars::Handle<double> stop_diff;
+    Vars::Handle<int> report_step_every;
+    Vars::Handle<int> return_after_each_step;
+    Vars::Handle<int> enable_fluid;
+    Vars::Handle<int> enable_advection;
+    Vars::Handle<int> enable_bubgen;
+    Vars::Handle<int> enable_erasevf;
+    Vars::Handle<int> stat_dissip;
+    Vars::Handle<int> enstrophy;
+    Vars::Handle<int> stat_step_every;
+    Vars::Handle<double> cfl;
+    Vars::Handle<double> cfla;
+    Vars::Handle<double> cflt;
+    Vars::Handle<double> cflp;
+    Vars::Handle<double> dtmax;
+    Vars::Handle<double> abortvel;
+    Vars::Handle<double> tol;
+    Vars::Handle<int> min_iter;
+    Vars::Handle<int> max_iter;
+    Vars::Handle<int> vfsmooth;
+    Vars::Handle<int> vfsmooth_extrapolate_cut;
+    Vars::Handle<std::vector<double>> force;
+    Vars::Handle<std::vector<double>> gravity;
+    Vars::Handle<double> rho1;
+    Vars::Handle<double> rho2;
+    Vars::Handle<double> mu1;
+    Vars::Handle<double> mu2;
+    Vars::Handle<int> enable_surftens;
+    Vars::Handle<int> dim;
+    Vars::Handle<int> dumppart;
+    Vars::Handle<int> dumppartinter;
+  };
+  VarHandles vh_;
   SingleTimer timer_;
   std::shared_ptr<linear::Solver<M>> linsolver_symm_;
 
@@ -58,6 +58,7 @@
 #include "solver/vofm.h"
 #include "util/convdiff.h"
 #include "util/events.h"
+#include "util/memtrack.h"
 #include "util/filesystem.h"
 #include "util/format.h"
 #include "util/hydro.h"
@@ -177,6 +178,7 @@ auto Hydro<M>::GetDiv() const -> FieldCell<Scal> {
 
 template <class M>
 void Hydro<M>::InitEmbed() {
+  MEMTRACK_SCOPE("embed");
   if (var.Int["enable_embed"]) {
     auto sem = m.GetSem("embed");
     struct {
@@ -435,6 +437,7 @@ void Hydro<M>::SpawnParticles(ParticlesView& view) {
 
 template <class M>
 void Hydro<M>::InitParticles() {
+  MEMTRACK_SCOPE("particles");
   if (var.Int["enable_particles"]) {
     typename ParticlesInterface<M>::Conf conf;
     conf.mixture_density = var.Double["rho1"];
@@ -471,6 +474,7 @@ void Hydro<M>::InitParticles() {
 
 template <class M>
 void Hydro<M>::InitElectro() {
+  MEMTRACK_SCOPE("electro");
   if (var.Int["enable_electro"]) {
     if (!linsolver_symm_) {
       linsolver_symm_ = ULinear<M>::MakeLinearSolver(var, "symm", m);
@@ -487,6 +491,7 @@ void Hydro<M>::InitElectro() {
 
 template <class M>
 void Hydro<M>::InitTracer(Multi<FieldCell<Scal>>& vfcu) {
+  MEMTRACK_SCOPE("tracer");
   if (var.Int["enable_tracer"]) {
     auto multi = [](const std::vector<Scal>& v) {
       Multi<Scal> w(v.size());
@@ -583,6 +588,7 @@ void Hydro<M>::InitTracer(Multi<FieldCell<Scal>>& vfcu) {
 
 template <class M>
 void Hydro<M>::InitFluid(const FieldCell<Vect>& fc_vel) {
+  MEMTRACK_SCOPE("fluid");
   fcvm_ = fc_vel;
 
   std::string fs = var.String["fluid_solver"];
@@ -635,6 +641,7 @@ void Hydro<M>::InitFluid(const FieldCell<Vect>& fc_vel) {
 template <class M>
 void Hydro<M>::InitAdvection(
     const FieldCell<Scal>& fcvf, const FieldCell<Scal>& fccl) {
+  MEMTRACK_SCOPE("advection");
   const std::string solver = var.String["advection_solver"];
 
   const auto modname = var.String["labeling"];
@@ -1467,16 +1474,53 @@ Hydro<M>::Hydro(Vars& var0, const BlockInfoProxy& bi, Par& par)
     , dumper_(var, "dump_field_")
     , dmptraj_(var, "dump_traj_")
     , dmptrep_(var, "dump_trep_")
-    , bubgen_(var, "bubgen_") {}
+    , bubgen_(var, "bubgen_")
+    , vh_(var) {}
+
+template <class M>
+Hydro<M>::VarHandles::VarHandles(const Vars& var)
+    : tmax(var.Double.GetHandle("tmax"))
+    , max_step(var.Int.GetHandle("max_step"))
+    , stop_diff(var.Double.GetHandle("stop_diff", 0))
+    , report_step_every(var.Int.GetHandle("report_step_every", 1))
+    , return_after_each_step(var.Int.GetHandle("return_after_each_step", 0))
+    , enable_fluid(var.Int.GetHandle("enable_fluid"))
+    , enable_advection(var.Int.GetHandle("enable_advection"))
+    , enable_bubgen(var.Int.GetHandle("enable_bubgen"))
+    , enable_erasevf(var.Int.GetHandle("enable_erasevf"))
+    , stat_dissip(var.Int.GetHandle("stat_dissip"))
+    , enstrophy(var.Int.GetHandle("enstrophy"))
+    , stat_step_every(var.Int.GetHandle("stat_step_every", 1))
+    , cfl(var.Double.GetHandle("cfl"))
+    , cfla(var.Double.GetHandle("cfla"))
+    , cflt(var.Double.GetHandle("cflt"))
+    , cflp(var.Double.GetHandle("cflp"))
+    , dtmax(var.Double.GetHandle("dtmax"))
+    , abortvel(var.Double.GetHandle("abortvel"))
+    , tol(var.Double.GetHandle("tol"))
+    , min_iter(var.Int.GetHandle("min_iter"))
+    , max_iter(var.Int.GetHandle("max_iter"))
+    , vfsmooth(var.Int.GetHandle("vfsmooth"))
+    , vfsmooth_extrapolate_cut(var.Int.GetHandle("vfsmooth_extrapolate_cut"))
+    , force(var.Vect.GetHandle("force"))
+    , gravity(var.Vect.GetHandle("gravity"))
+    , rho1(var.Double.GetHandle("rho1"))
+    , rho2(var.Double.GetHandle("rho2"))
+    , mu1(var.Double.GetHandle("mu1"))
+    , mu2(var.Double.GetHandle("mu2"))
+    , enable_surftens(var.Int.GetHandle("enable_surftens"))
+    , dim(var.Int.GetHandle("dim"))
+    , dumppart(var.Int.GetHandle("dumppart"))
+    , dumppartinter(var.Int.GetHandle("dumppartinter")) {}
 
 template <class M>
 void Hydro<M>::CalcStat() {
   auto sem = m.GetSem("stat");
   if (sem("local")) {
-    if (var.Int["stat_dissip"]) {
+    if (*vh_.stat_dissip) {
       fc_strain_ = CalcStrain(fs_->GetVelocity());
     }
-    if (var.Int["enstrophy"]) {
+    if (*vh_.enstrophy) {
       CalcVort();
     }
   }
@@ -1496,9 +1540,9 @@ void Hydro<M>::CalcDt() {
   }
   if (sem("reduce")) {
     // set from cfl if defined
-    if (auto* cfl = var.Double.Find("cfl")) {
+    if (auto* cfl = vh_.cfl.Find()) {
       st_.dt = ctx->dtmin * (*cfl);
-      st_.dt = std::min<Scal>(st_.dt, var.Double["dtmax"]);
+      st_.dt = std::min<Scal>(st_.dt, *vh_.dtmax);
     }
 
     { // constraint from surface tension
@@ -1518,9 +1562,9 @@ void Hydro<M>::CalcDt() {
     fs_->SetTimeStep(st_.dt);
 
     // set from cfla if defined
-    if (auto* cfla = var.Double.Find("cfla")) {
+    if (auto* cfla = vh_.cfla.Find()) {
       st_.dta = ctx->dtmin * (*cfla);
-      st_.dta = std::min<Scal>(st_.dta, var.Double["dtmax"]);
+      st_.dta = std::min<Scal>(st_.dta, *vh_.dtmax);
     }
     // round up dta to such that dt / dta is integer
     const Scal dt = fs_->GetTime() + fs_->GetTimeStep() - as_->GetTime();
@@ -1528,7 +1572,7 @@ void Hydro<M>::CalcDt() {
     as_->SetTimeStep(st_.dta);
 
     if (tracer_) {
-      if (auto* cflt = var.Double.Find("cflt")) {
+      if (auto* cflt = vh_.cflt.Find()) {
         tracer_dt_ = ctx->dtmin * (*cflt);
         // round up dta to such that dt / dta is integer
         const Scal dtwhole =
@@ -1540,7 +1584,7 @@ void Hydro<M>::CalcDt() {
     }
 
     if (particles_) {
-      if (auto* cflp = var.Double.Find("cflp")) {
+      if (auto* cflp = vh_.cflp.Find()) {
         particles_dt_ = ctx->dtmin * (*cflp);
         // round up dta to such that dt / dta is integer
         const Scal dtwhole =
@@ -1579,7 +1623,7 @@ void Hydro<M>::CalcMixture(const FieldCell<Scal>& fc_vf0) {
     fc_src_.Reinit(m, 0);
     fc_src2_.Reinit(m, 0);
     fc_smvf_ = fc_vf0;
-    if (eb_ && var.Int["vfsmooth_extrapolate_cut"]) {
+    if (eb_ && *vh_.vfsmooth_extrapolate_cut) {
       auto& eb = *eb_;
       for (auto c : eb.CFaces()) {
         fc_smvf_[c] = fc_vf0[eb.GetRegularNeighbor(c)];
@@ -1593,10 +1637,10 @@ void Hydro<M>::CalcMixture(const FieldCell<Scal>& fc_vf0) {
   }
 
   if (sem.Nested("smooth")) {
-    if (eb_ && var.Int["vfsmooth_extrapolate_cut"]) {
-      Smoothen(fc_smvf_, mebc_vfsm_, *eb_, var.Int["vfsmooth"]);
+    if (eb_ && *vh_.vfsmooth_extrapolate_cut) {
+      Smoothen(fc_smvf_, mebc_vfsm_, *eb_, *vh_.vfsmooth);
     } else {
-      Smoothen(fc_smvf_, mebc_vfsm_, m, var.Int["vfsmooth"]);
+      Smoothen(fc_smvf_, mebc_vfsm_, m, *vh_.vfsmooth);
     }
   }
 
@@ -1609,12 +1653,12 @@ void Hydro<M>::CalcMixture(const FieldCell<Scal>& fc_vf0) {
       ffvf = UEB::Interpolate(fcvfsm, mebc_vfsm_, m);
     }
 
-    const Vect force(var.Vect["force"]);
-    const Vect grav(var.Vect["gravity"]);
-    const Scal rho1(var.Double["rho1"]);
-    const Scal rho2(var.Double["rho2"]);
-    const Scal mu1(var.Double["mu1"]);
-    const Scal mu2(var.Double["mu2"]);
+    const Vect force(*vh_.force);
+    const Vect grav(*vh_.gravity);
+    const Scal rho1(*vh_.rho1);
+    const Scal rho2(*vh_.rho2);
+    const Scal mu1(*vh_.mu1);
+    const Scal mu2(*vh_.mu2);
 
     // Init density and viscosity
     for (auto c : m.AllCells()) {
@@ -1657,14 +1701,14 @@ void Hydro<M>::CalcMixture(const FieldCell<Scal>& fc_vf0) {
     }
 
     // Surface tension
-    if (var.Int["enable_surftens"] && as_) {
+    if (*vh_.enable_surftens && as_) {
       CalcSurfaceTension(
           m, layers, var, fc_force_, febp_.GetFieldFace(), fc_sig_,
           GetBCondZeroGrad<Scal>(mebc_fluid_), fck_, fc_vf0, ffvf, as_.get());
     }
 
     // zero force in z if 2D
-    const size_t edim = var.Int["dim"];
+    const size_t edim = *vh_.dim;
     if (edim < M::dim) {
       for (auto f : m.Faces()) {
         using Dir = typename M::Dir;
@@ -1844,10 +1888,11 @@ void Hydro<M>::Dump(bool force) {
     }
   }
   if (sem("dmptrep")) {
-    if (m.IsRoot() && dmptrep_.Try(st_.t, st_.dt)) {
+    // Requested on all blocks, see Mesh::TimerReport()
+    if (dmptrep_.Try(st_.t, st_.dt)) {
       const std::string path = GetDumpName("trep", ".log", dmptrep_.GetN());
       m.TimerReport(path);
-      if (!silent_) {
+      if (m.IsRoot() && !silent_) {
         std::cerr << std::fixed << std::setprecision(8) << "timer report"
                   << " t=" << st_.t << " to " << path << std::endl;
       }
@@ -1855,7 +1900,7 @@ void Hydro<M>::Dump(bool force) {
   }
   if (sem("dumpstat")) {
     if (m.IsRoot() && dumpstat_) {
-      if (st_.step % var.Int("stat_step_every", 1) == 0 || force) {
+      if (st_.step % *vh_.stat_step_every == 0 || force) {
         stat_->WriteValues(fstat_);
       }
     }
@@ -1867,11 +1912,11 @@ void Hydro<M>::Dump(bool force) {
     if (auto* curv = dynamic_cast<const curvature::Particles<M>*>(
             curv_estimator_.get())) {
       if (dumper_.Try(st_.t, st_.dt)) {
-        if (var.Int["dumppart"] && sem.Nested("part-dump")) {
+        if (*vh_.dumppart && sem.Nested("part-dump")) {
           curv->GetParticles()->DumpParticles(
               as->GetAlpha(), as->GetNormal(), dumper_.GetN(), st_.t);
         }
-        if (var.Int["dumppartinter"] && sem.Nested("partinter-dump")) {
+        if (*vh_.dumppartinter && sem.Nested("partinter-dump")) {
           curv->GetParticles()->DumpPartInter(
               as->GetAlpha(), as->GetNormal(), dumper_.GetN(), st_.t);
         }
@@ -1910,6 +1955,7 @@ void Hydro<M>::Dump(bool force) {
 
 template <class M>
 void Hydro<M>::Run() {
+  MEMTRACK_SCOPE("hydro");
   auto sem = m.GetSem("run");
   struct {
     Scal nabort;
@@ -1928,30 +1974,30 @@ void Hydro<M>::Run() {
     }
   }
   if (sem("loop-check")) {
-    if (st_.t + st_.dt * 0.25 > var.Double["tmax"]) {
+    if (st_.t + st_.dt * 0.25 > *vh_.tmax) {
       if (m.IsRoot() && !silent_) {
-        std::cerr << "End of simulation, t > tmax=" << var.Double["tmax"]
+        std::cerr << "End of simulation, t > tmax=" << *vh_.tmax
                   << std::endl;
       }
       sem.LoopBreak();
       finished_ = true;
-    } else if (int(st_.step + 0.5) >= var.Int["max_step"]) {
+    } else if (int(st_.step + 0.5) >= *vh_.max_step) {
       if (m.IsRoot() && !silent_) {
-        std::cerr << "End of simulation, step > max_step="
-                  << var.Int["max_step"] << std::endl;
+        std::cerr << "End of simulation, step > max_step=" << *vh_.max_step
+                  << std::endl;
       }
       sem.LoopBreak();
       finished_ = true;
-    } else if (st_.step > 1 && fs_->GetError() < var.Double("stop_diff", 0)) {
+    } else if (st_.step > 1 && fs_->GetError() < *vh_.stop_diff) {
       if (m.IsRoot() && !silent_) {
-        std::cerr << "End of simulation, diff < stop_diff="
-                  << var.Double["stop_diff"] << std::endl;
+        std::cerr << "End of simulation, diff < stop_diff=" << *vh_.stop_diff
+                  << std::endl;
       }
       sem.LoopBreak();
       finished_ = true;
     } else {
       if (m.IsRoot() && !silent_) {
-        if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+        if (st_.step % *vh_.report_step_every == 0 && !silent_) {
           ReportStep();
         }
       }
@@ -1981,18 +2027,20 @@ void Hydro<M>::Run() {
     CalcMixture(as_->GetField());
   }
   if (sem.Nested("fs-start")) {
+    MEMTRACK_SCOPE("fluid");
     fs_->StartStep();
   }
   if (sem.Nested("fs-iters")) {
-    if (var.Int["enable_fluid"]) {
+    if (*vh_.enable_fluid) {
       StepFluid();
     }
   }
   if (sem.Nested("fs-finish")) {
+    MEMTRACK_SCOPE("fluid");
     fs_->FinishStep();
   }
   if (sem.Nested("as-steps")) {
-    if (var.Int["enable_advection"]) {
+    if (*vh_.enable_advection) {
       StepAdvection();
     }
   }
@@ -2034,7 +2082,7 @@ void Hydro<M>::Run() {
   }
   if (sem("inc")) {
     ++st_.step;
-    if (var.Int("return_after_each_step", 0)) {
+    if (*vh_.return_after_each_step) {
       sem.LoopBreak();
     }
   }
@@ -2046,6 +2094,10 @@ void Hydro<M>::Run() {
     }
   }
 
+  if (sem.Nested("report_memory") && finished_ && !silent_ &&
+      var.Int("report_memory", 0)) {
+    ReportMemory(std::cerr);
+  }
   if (sem.Nested("posthook") && finished_) {
     if (eb_) {
       PostHook(var, fs_->GetVelocity(), m, *eb_);
@@ -2146,7 +2198,7 @@ void Hydro<M>::ReportIter() {
 template <class M>
 void Hydro<M>::CheckAbort(Sem& sem, Scal& nabort) {
   if (sem("abort-local")) {
-    const Scal abortvel = var.Double["abortvel"];
+    const Scal abortvel = *vh_.abortvel;
     CHECKNAN(as_->GetField(), true)
     CHECKNAN(fs_->GetVelocity(), true)
     CHECKNAN(fs_->GetPressure(), true)
@@ -2173,6 +2225,7 @@ void Hydro<M>::CheckAbort(Sem& sem, Scal& nabort) {
 
 template <class M>
 void Hydro<M>::StepFluid() {
+  MEMTRACK_SCOPE("fluid");
   auto sem = m.GetSem("iter"); // sem nested
   if (sem("iter")) {
     OverwriteBc();
@@ -2187,16 +2240,15 @@ void Hydro<M>::StepFluid() {
       this->var_mutable.Int["iter"] = st_.iter;
     }
     if (m.IsRoot()) {
-      if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+      if (st_.step % *vh_.report_step_every == 0 && !silent_) {
         ReportIter();
       }
     }
   }
   if (sem("convcheck")) {
     auto it = fs_->GetIter();
-    if ((fs_->GetError() < var.Double["tol"] &&
-         (int)it >= var.Int["min_iter"]) ||
-        (int)it >= var.Int["max_iter"]) {
+    if ((fs_->GetError() < *vh_.tol && (int)it >= *vh_.min_iter) ||
+        (int)it >= *vh_.max_iter) {
       sem.LoopBreak();
     }
   }
@@ -2206,6 +2258,7 @@ void Hydro<M>::StepFluid() {
 
 template <class M>
 void Hydro<M>::StepTracer() {
+  MEMTRACK_SCOPE("tracer");
   auto sem = m.GetSem("tracer-steps"); // sem nested
   sem.LoopBegin();
   if (sem("spawn")) {
@@ -2216,7 +2269,7 @@ void Hydro<M>::StepTracer() {
   }
   if (sem("report")) {
     if (m.IsRoot()) {
-      if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+      if (st_.step % *vh_.report_step_every == 0 && !silent_) {
         ReportStepTracer();
       }
     }
@@ -2231,6 +2284,7 @@ void Hydro<M>::StepTracer() {
 
 template <class M>
 void Hydro<M>::StepParticles() {
+  MEMTRACK_SCOPE("particles");
   auto sem = m.GetSem("particles-steps"); // sem nested
   sem.LoopBegin();
   if (sem.Nested("start")) {
@@ -2250,7 +2304,7 @@ void Hydro<M>::StepParticles() {
   }
   if (sem("report")) {
     if (m.IsRoot()) {
-      if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+      if (st_.step % *vh_.report_step_every == 0 && !silent_) {
         ReportStepParticles();
       }
     }
@@ -2265,13 +2319,14 @@ void Hydro<M>::StepParticles() {
 
 template <class M>
 void Hydro<M>::StepElectro() {
+  MEMTRACK_SCOPE("electro");
   auto sem = m.GetSem(__func__);
   if (sem.Nested("start")) {
     electro_->Step(fs_->GetTimeStep(), as_->GetField());
   }
   if (sem("report")) {
     if (m.IsRoot()) {
-      if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+      if (st_.step % *vh_.report_step_every == 0 && !silent_) {
         ReportStepElectro();
       }
     }
@@ -2280,6 +2335,7 @@ void Hydro<M>::StepElectro() {
 
 template <class M>
 void Hydro<M>::StepAdvection() {
+  MEMTRACK_SCOPE("advection");
   auto sem = m.GetSem("steps"); // sem nested
   sem.LoopBegin();
   if (auto as = dynamic_cast<ASVM*>(as_.get())) {
@@ -2319,7 +2375,7 @@ void Hydro<M>::StepAdvection() {
   }
   if (sem("report")) {
     if (m.IsRoot()) {
-      if (st_.step % var.Int("report_step_every", 1) == 0 && !silent_) {
+      if (st_.step % *vh_.report_step_every == 0 && !silent_) {
         ReportStepAdv();
       }
     }
@@ -2340,12 +2396,12 @@ void Hydro<M>::StepAdvection() {
       curv_estimator_->CalcCurvature(fck_, as_->GetPlic(), m, m);
     }
   }
-  if (var.Int["enable_bubgen"]) {
+  if (*vh_.enable_bubgen) {
     if (sem.Nested("bubgen")) {
       StepBubgen();
     }
   }
-  if (var.Int["enable_erasevf"]) {
+  if (*vh_.enable_erasevf) {
     if (sem("erasevf")) {
       StepEraseVolumeFraction("erasevf", erasevf_last_t_);
       StepEraseVolumeFraction("erasevf2", erasevf2_last_t_);
@@ -2551,6 +2607,80 @@ void Hydro<M>::ReportSysinfo(std::ostream& out) {
       }
     }
   }
+  if (var.Int("report_memory", 0) && sem.Nested("memory")) {
+    ReportMemory(out);
+  }
+}
+
+template <class M>
+void Hydro<M>::ReportMemory(std::ostream& out) {
+  auto sem = m.GetSem(__func__);
+  struct {
+    // usage of each owner on each rank
+    std::vector<std::vector<char>> name;
+    std::vector<size_t> current;
+    std::vector<size_t> peak;
+    std::vector<size_t> peak_rank; // sum of peaks on each rank
+  } * ctx(sem);
+  auto& t = *ctx;
+  if (sem()) {
+    if (m.IsLead()) {
+      t.peak_rank.push_back(0);
+      for (const auto& u : memtrack::GetUsage()) {
+        t.name.push_back({u.name.begin(), u.name.end()});
+        t.current.push_back(u.current);
+        t.peak.push_back(u.peak);
+        t.peak_rank.back() += u.peak;
+      }
+    }
+    m.Reduce(&t.name, Reduction::concat);
+    m.Reduce(&t.current, Reduction::concat);
+    m.Reduce(&t.peak, Reduction::concat);
+    m.Reduce(&t.peak_rank, Reduction::concat);
+  }
+  if (sem()) {
+    if (m.IsRoot()) {
+      struct Total {
+        size_t current = 0; // sum over ranks
+        size_t peak = 0; // sum over ranks
+        size_t peak_max = 0; // maximum over ranks
+      };
+      std::map<std::string, Total> map;
+      Total all;
+      for (size_t i = 0; i < t.name.size(); ++i) {
+        auto& e = map[std::string(t.name[i].begin(), t.name[i].end())];
+        e.current += t.current[i];
+        e.peak += t.peak[i];
+        e.peak_max = std::max(e.peak_max, t.peak[i]);
+        all.current += t.current[i];
+        all.peak += t.peak[i];
+      }
+      for (auto p : t.peak_rank) {
+        all.peak_max = std::max(all.peak_max, p);
+      }
+      // Fraction of cells in halos, estimates the overhead of cell fields
+      const Scal halo = 1 - Scal(m.GetInBlockCells().size()) /
+                                m.GetAllBlockCells().size();
+      const std::string fmt = "{:12} {:12} {:12} {:12} {:12}\n";
+      auto mb = [](size_t bytes) {
+        return util::Format("{:.3f}", double(bytes) / (1 << 20));
+      };
+      out << "\nMemory by owner (MiB), sum over ranks, halo cells "
+          << util::Format("{:.1f}%", halo * 100) << '\n';
+      out << util::Format(
+          fmt, "owner", "current", "peak", "peak_max", "halo");
+      auto print = [&](const std::string& name, const Total& e) {
+        out << util::Format(
+            fmt, name, mb(e.current), mb(e.peak), mb(e.peak_max),
+            mb(e.current * halo));
+      };
+      for (const auto& p : map) {
+        print(p.first, p.second);
+      }
+      print("all", all);
+      out << '\n';
+    }
+  }
 }
 
 // Finds the minimal color in rectangle [x0,x1]
@@ -0,0 +1,17 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#include "bicgstab.ipp"
+
+namespace linear {
+
+#define X(dim) template class SolverBicgstab<MeshCartesian<double, dim>>;
+MULTIDIMX
+#undef X
+
+#define X(dim) \
+  RegisterModule<ModuleLinearBicgstab<MeshCartesian<double, dim>>>(),
+bool kReg_bicgstab[] = {MULTIDIMX};
+#undef X
+
+} // namespace linear
@@ -0,0 +1,37 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <memory>
+
+#include "linear.h"
+
+namespace linear {
+
+// Stabilized biconjugate gradients (van der Vorst, 1992)
+// for non-symmetric systems with optional right preconditioning.
+template <class M>
+class SolverBicgstab : public Solver<M> {
+ public:
+  using Base = Solver<M>;
+  using Conf = typename Base::Conf;
+  using Info = typename Base::Info;
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+  struct Extra {
+    bool residual_max = false; // if true, use max-norm of residual, else L2
+    std::shared_ptr<Precond<M>> precond; // preconditioner, nullptr for none
+  };
+  SolverBicgstab(const Conf& conf, const Extra& extra, const M&);
+  ~SolverBicgstab();
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
+
+ private:
+  struct Imp;
+  const std::unique_ptr<Imp> imp;
+};
+
+} // namespace linear
@@ -0,0 +1,238 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "bicgstab.h"
+#include "util/memtrack.h"
+
+DECLARE_FORCE_LINK_TARGET(linear_bicgstab);
+
+namespace linear {
+
+template <class M>
+struct SolverBicgstab<M>::Imp {
+  using Owner = SolverBicgstab<M>;
+
+  Imp(Owner* owner, const Extra& extra_, const M&)
+      : owner_(owner), conf(owner_->conf), extra(extra_) {}
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    struct {
+      FieldCell<Scal> fcx; // solution
+      FieldCell<Scal> fcr; // residual
+      FieldCell<Scal> fcr0; // shadow residual
+      FieldCell<Scal> fcp; // search direction
+      FieldCell<Scal> fcv; // A y
+      FieldCell<Scal> fcy; // preconditioned p
+      FieldCell<Scal> fcz; // preconditioned s
+      FieldCell<Scal> fct; // A z
+      Scal rho; // r0 * r
+      Scal rho_prev;
+      Scal alpha;
+      Scal omega;
+      Scal dot_r0_v;
+      Scal dot_t_s;
+      Scal dot_t_t;
+      Scal dot_r;
+      Scal max_r;
+      bool restart = true; // start with p = r
+
+      int iter = 0;
+      Info info;
+    } * ctx(sem);
+    auto& t = *ctx;
+    const bool precond = bool(extra.precond);
+    if (sem("init")) {
+      if (fc_init) {
+        t.fcx = *fc_init;
+      } else {
+        t.fcx.Reinit(m, 0);
+      }
+      t.fcr.Reinit(m, 0);
+      ComputeResidual(fc_system, t.fcx, t.fcr, m);
+      t.fcr0 = t.fcr;
+      t.rho = 0;
+      for (auto c : m.Cells()) {
+        t.rho += sqr(t.fcr[c]);
+      }
+      m.Reduce(&t.rho, Reduction::sum);
+      t.fcp.Reinit(m, 0);
+      t.fcv.Reinit(m, 0);
+      t.fcy.Reinit(m, 0);
+      t.fcz.Reinit(m, 0);
+      t.fct.Reinit(m, 0);
+    }
+    if (precond) {
+      if (sem.Nested("setup")) {
+        extra.precond->Setup(fc_system, m);
+      }
+    }
+    sem.LoopBegin();
+    if (sem("direction")) {
+      if (t.restart) {
+        for (auto c : m.Cells()) {
+          t.fcp[c] = t.fcr[c];
+        }
+        t.restart = false;
+      } else {
+        const Scal beta =
+            (t.rho / (t.rho_prev + 1e-100)) * (t.alpha / (t.omega + 1e-100));
+        for (auto c : m.Cells()) {
+          t.fcp[c] = t.fcr[c] + beta * (t.fcp[c] - t.omega * t.fcv[c]);
+        }
+      }
+      if (!precond) {
+        for (auto c : m.Cells()) {
+          t.fcy[c] = t.fcp[c];
+        }
+        m.Comm(&t.fcy, M::CommStencil::direct_one);
+      }
+    }
+    if (precond) {
+      if (sem.Nested("precond")) {
+        extra.precond->Apply(t.fcp, t.fcy, m);
+      }
+      if (sem("halo")) {
+        m.Comm(&t.fcy, M::CommStencil::direct_one);
+      }
+    }
+    if (sem("iter")) {
+      ApplyLinear(fc_system, t.fcy, t.fcv, m);
+      t.dot_r0_v = 0;
+      for (auto c : m.Cells()) {
+        t.dot_r0_v += t.fcr0[c] * t.fcv[c];
+      }
+      m.Reduce(&t.dot_r0_v, Reduction::sum);
+    }
+    if (sem("iter2")) {
+      t.alpha = t.rho / (t.dot_r0_v + 1e-100);
+      // r becomes s = r - alpha * v
+      for (auto c : m.Cells()) {
+        t.fcx[c] += t.alpha * t.fcy[c];
+        t.fcr[c] -= t.alpha * t.fcv[c];
+      }
+      if (!precond) {
+        for (auto c : m.Cells()) {
+          t.fcz[c] = t.fcr[c];
+        }
+        m.Comm(&t.fcz, M::CommStencil::direct_one);
+      }
+    }
+    if (precond) {
+      if (sem.Nested("precond")) {
+        extra.precond->Apply(t.fcr, t.fcz, m);
+      }
+      if (sem("halo")) {
+        m.Comm(&t.fcz, M::CommStencil::direct_one);
+      }
+    }
+    if (sem("iter3")) {
+      ApplyLinear(fc_system, t.fcz, t.fct, m);
+      t.dot_t_s = 0;
+      t.dot_t_t = 0;
+      for (auto c : m.Cells()) {
+        t.dot_t_s += t.fct[c] * t.fcr[c];
+        t.dot_t_t += sqr(t.fct[c]);
+      }
+      m.Reduce(&t.dot_t_s, Reduction::sum);
+      m.Reduce(&t.dot_t_t, Reduction::sum);
+    }
+    if (sem("iter4")) {
+      t.omega = t.dot_t_s / (t.dot_t_t + 1e-100);
+      t.rho_prev = t.rho;
+      t.rho = 0;
+      t.dot_r = 0;
+      t.max_r = 0;
+      for (auto c : m.Cells()) {
+        t.fcx[c] += t.omega * t.fcz[c];
+        t.fcr[c] -= t.omega * t.fct[c];
+        t.rho += t.fcr0[c] * t.fcr[c];
+        t.dot_r += sqr(t.fcr[c]);
+        t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
+      }
+      m.Reduce(&t.rho, Reduction::sum);
+      m.Reduce(&t.dot_r, Reduction::sum);
+      m.Reduce(&t.max_r, Reduction::max);
+    }
+    if (sem("check")) {
+      if (extra.residual_max) {
+        t.info.residual = t.max_r / m.GetCellSize().prod();
+      } else { // L2-norm
+        t.info.residual = std::sqrt(t.dot_r / m.GetCellSize().prod());
+      }
+      ++t.iter;
+      t.info.iter = t.iter;
+      if (t.iter >= conf.miniter &&
+          (t.iter > conf.maxiter || t.info.residual < conf.tol)) {
+        sem.LoopBreak();
+      }
+      // restart if r0 became orthogonal to r
+      if (std::abs(t.rho) < 1e-12 * t.dot_r) {
+        t.fcr0 = t.fcr;
+        t.rho = t.dot_r;
+        t.restart = true;
+      }
+    }
+    sem.LoopEnd();
+    if (sem("result")) {
+      fc_sol = t.fcx;
+      m.Comm(&fc_sol, M::CommStencil::direct_one);
+      if (m.flags.linreport && m.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(bicgstab) '" + fc_system.GetName() + "':"
+                  << " res=" << t.info.residual << " iter=" << t.info.iter
+                  << std::endl;
+      }
+    }
+    if (sem()) {
+    }
+    return t.info;
+  }
+
+ private:
+  Owner* owner_;
+  Conf& conf;
+  Extra extra;
+};
+
+template <class M>
+SolverBicgstab<M>::SolverBicgstab(
+    const Conf& conf_, const Extra& extra, const M& m)
+    : Base(conf_), imp(new Imp(this, extra, m)) {}
+
+template <class M>
+SolverBicgstab<M>::~SolverBicgstab() = default;
+
+template <class M>
+auto SolverBicgstab<M>::Solve(
+    const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(fc_system, fc_init, fc_sol, m);
+}
+
+template <class M>
+class ModuleLinearBicgstab : public ModuleLinear<M> {
+ public:
+  ModuleLinearBicgstab() : ModuleLinear<M>("bicgstab") {}
+  std::unique_ptr<Solver<M>> Make(
+      const Vars& var, std::string prefix, const M& m) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    typename SolverBicgstab<M>::Extra extra;
+    extra.residual_max = var.Int(addprefix("maxnorm"), 0);
+    extra.precond = MakePrecond(var, prefix, m);
+    return std::make_unique<SolverBicgstab<M>>(
+        this->GetConf(var, prefix), extra, m);
+  }
+};
+
+} // namespace linear
@@ -0,0 +1,18 @@
+// Created by Petr Karnakov on 05.04.2021
+// Copyright 2021 ETH Zurich
+
+#include "conjugate_pipelined.ipp"
+
+namespace linear {
+
+#define X(dim) \
+  template class SolverConjugatePipelined<MeshCartesian<double, dim>>;
+MULTIDIMX
+#undef X
+
+#define X(dim) \
+  RegisterModule<ModuleLinearConjugatePipelined<MeshCartesian<double, dim>>>(),
+bool kReg_conjugate_pipelined[] = {MULTIDIMX};
+#undef X
+
+} // namespace linear
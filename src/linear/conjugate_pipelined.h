@@ -0,0 +1,39 @@
+// Created by Petr Karnakov on 05.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <memory>
+
+#include "linear.h"
+
+namespace linear {
+
+// Pipelined conjugate gradients (Ghysels and Vanroose, 2014)
+// with one fused non-blocking reduction per iteration.
+// Equivalent to SolverConjugate in exact arithmetic,
+// but the reduction is overlapped with the stencil application
+// and the iteration takes two stages instead of four.
+template <class M>
+class SolverConjugatePipelined : public Solver<M> {
+ public:
+  using Base = Solver<M>;
+  using Conf = typename Base::Conf;
+  using Info = typename Base::Info;
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+  struct Extra {
+    bool residual_max = false; // if true, use max-norm of residual, else L2
+  };
+  SolverConjugatePipelined(const Conf& conf, const Extra& extra, const M&);
+  ~SolverConjugatePipelined();
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
+
+ private:
+  struct Imp;
+  const std::unique_ptr<Imp> imp;
+};
+
+} // namespace linear
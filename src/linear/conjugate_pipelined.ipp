@@ -0,0 +1,181 @@
+// Created by Petr Karnakov on 05.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+#include "conjugate_pipelined.h"
+#include "util/memtrack.h"
+
+DECLARE_FORCE_LINK_TARGET(linear_conjugate_pipelined);
+
+namespace linear {
+
+template <class M>
+struct SolverConjugatePipelined<M>::Imp {
+  using Owner = SolverConjugatePipelined<M>;
+
+  Imp(Owner* owner, const Extra& extra_, const M&)
+      : owner_(owner), conf(owner_->conf), extra(extra_) {}
+  // Notation follows Algorithm 4 of (Ghysels and Vanroose, 2014)
+  // without preconditioner, so that u = r and m = w.
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    struct {
+      FieldCell<Scal> fcx; // solution
+      FieldCell<Scal> fcr; // residual
+      FieldCell<Scal> fcw; // A r
+      FieldCell<Scal> fcn; // A w
+      FieldCell<Scal> fcp; // search direction
+      FieldCell<Scal> fcs; // A p
+      FieldCell<Scal> fcz; // A s
+      Scal gamma; // r * r
+      Scal delta; // w * r
+      Scal max_r;
+      Scal gamma_prev;
+      Scal alpha_prev;
+
+      int iter = 0;
+      Info info;
+    } * ctx(sem);
+    auto& t = *ctx;
+    // Computes dot products of current r and w,
+    // the reduction is completed at the end of the next stage
+    auto reduce = [&]() {
+      t.gamma = 0;
+      t.delta = 0;
+      t.max_r = 0;
+      for (auto c : m.Cells()) {
+        t.gamma += sqr(t.fcr[c]);
+        t.delta += t.fcw[c] * t.fcr[c];
+        t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
+      }
+      m.ReduceDeferred(&t.gamma, Reduction::sum);
+      m.ReduceDeferred(&t.delta, Reduction::sum);
+      if (extra.residual_max) {
+        m.ReduceDeferred(&t.max_r, Reduction::max);
+      }
+    };
+    if (sem("init")) {
+      if (fc_init) {
+        t.fcx = *fc_init;
+      } else {
+        t.fcx.Reinit(m, 0);
+      }
+      t.fcr.Reinit(m, 0);
+      ComputeResidual(fc_system, t.fcx, t.fcr, m);
+      m.Comm(&t.fcr, M::CommStencil::direct_one);
+    }
+    if (sem("init")) {
+      t.fcw.Reinit(m, 0);
+      ApplyLinear(fc_system, t.fcr, t.fcw, m);
+      reduce();
+      m.Comm(&t.fcw, M::CommStencil::direct_one);
+      t.fcn.Reinit(m, 0);
+      t.fcp.Reinit(m, 0);
+      t.fcs.Reinit(m, 0);
+      t.fcz.Reinit(m, 0);
+    }
+    sem.LoopBegin();
+    if (sem("iter")) {
+      // overlapped with reduction of gamma and delta
+      ApplyLinear(fc_system, t.fcw, t.fcn, m);
+      m.WaitReduce();
+    }
+    if (sem("update")) {
+      if (extra.residual_max) {
+        t.info.residual = t.max_r / m.GetCellSize().prod();
+      } else { // L2-norm
+        t.info.residual = std::sqrt(t.gamma / m.GetCellSize().prod());
+      }
+      t.info.iter = t.iter;
+      if (t.iter >= std::max(conf.miniter, 1) &&
+          (t.iter > conf.maxiter || t.info.residual < conf.tol)) {
+        sem.LoopBreak();
+      } else {
+        Scal alpha;
+        Scal beta;
+        if (t.iter == 0) {
+          beta = 0;
+          alpha = t.gamma / (t.delta + 1e-100);
+        } else {
+          beta = t.gamma / (t.gamma_prev + 1e-100);
+          alpha = t.gamma /
+                  (t.delta - beta * t.gamma / (t.alpha_prev + 1e-100) + 1e-100);
+        }
+        for (auto c : m.Cells()) {
+          t.fcz[c] = t.fcn[c] + beta * t.fcz[c];
+          t.fcs[c] = t.fcw[c] + beta * t.fcs[c];
+          t.fcp[c] = t.fcr[c] + beta * t.fcp[c];
+          t.fcx[c] += alpha * t.fcp[c];
+          t.fcr[c] -= alpha * t.fcs[c];
+          t.fcw[c] -= alpha * t.fcz[c];
+        }
+        t.gamma_prev = t.gamma;
+        t.alpha_prev = alpha;
+        ++t.iter;
+        reduce();
+        m.Comm(&t.fcw, M::CommStencil::direct_one);
+      }
+    }
+    sem.LoopEnd();
+    if (sem("result")) {
+      fc_sol = t.fcx;
+      m.Comm(&fc_sol, M::CommStencil::direct_one);
+      if (m.flags.linreport && m.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(conjugate_pipelined) '" + fc_system.GetName() +
+                         "':"
+                  << " res=" << t.info.residual << " iter=" << t.info.iter
+                  << std::endl;
+      }
+    }
+    if (sem()) {
+    }
+    return t.info;
+  }
+
+ private:
+  Owner* owner_;
+  Conf& conf;
+  Extra extra;
+};
+
+template <class M>
+SolverConjugatePipelined<M>::SolverConjugatePipelined(
+    const Conf& conf_, const Extra& extra, const M& m)
+    : Base(conf_), imp(new Imp(this, extra, m)) {}
+
+template <class M>
+SolverConjugatePipelined<M>::~SolverConjugatePipelined() = default;
+
+template <class M>
+auto SolverConjugatePipelined<M>::Solve(
+    const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(fc_system, fc_init, fc_sol, m);
+}
+
+template <class M>
+class ModuleLinearConjugatePipelined : public ModuleLinear<M> {
+ public:
+  ModuleLinearConjugatePipelined() : ModuleLinear<M>("conjugate_pipelined") {}
+  std::unique_ptr<Solver<M>> Make(
+      const Vars& var, std::string prefix, const M& m) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    typename SolverConjugatePipelined<M>::Extra extra;
+    extra.residual_max = var.Int(addprefix("maxnorm"), 0);
+    return std::make_unique<SolverConjugatePipelined<M>>(
+        this->GetConf(var, prefix), extra, m);
+  }
+};
+
+} // namespace linear
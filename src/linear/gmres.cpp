@@ -0,0 +1,16 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#include "gmres.ipp"
+
+namespace linear {
+
+#define X(dim) template class SolverGmres<MeshCartesian<double, dim>>;
+MULTIDIMX
+#undef X
+
+#define X(dim) RegisterModule<ModuleLinearGmres<MeshCartesian<double, dim>>>(),
+bool kReg_gmres[] = {MULTIDIMX};
+#undef X
+
+} // namespace linear
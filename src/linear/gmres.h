@@ -0,0 +1,41 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <memory>
+
+#include "linear.h"
+
+namespace linear {
+
+// Restarted generalized minimal residual method GMRES(m)
+// for non-symmetric systems with optional right preconditioning
+// (flexible variant, the preconditioner may change between iterations).
+// Orthogonalization by classical Gram-Schmidt with one reorthogonalization,
+// each pass takes one fused reduction.
+// The residual is measured in L2-norm.
+template <class M>
+class SolverGmres : public Solver<M> {
+ public:
+  using Base = Solver<M>;
+  using Conf = typename Base::Conf;
+  using Info = typename Base::Info;
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+  struct Extra {
+    int restart = 20; // number of iterations before restart
+    std::shared_ptr<Precond<M>> precond; // preconditioner, nullptr for none
+  };
+  SolverGmres(const Conf& conf, const Extra& extra, const M&);
+  ~SolverGmres();
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
+
+ private:
+  struct Imp;
+  const std::unique_ptr<Imp> imp;
+};
+
+} // namespace linear
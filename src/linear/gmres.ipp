@@ -0,0 +1,290 @@
+// Created by Petr Karnakov on 07.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "gmres.h"
+#include "util/memtrack.h"
+
+DECLARE_FORCE_LINK_TARGET(linear_gmres);
+
+namespace linear {
+
+template <class M>
+struct SolverGmres<M>::Imp {
+  using Owner = SolverGmres<M>;
+
+  Imp(Owner* owner, const Extra& extra_, const M&)
+      : owner_(owner), conf(owner_->conf), extra(extra_) {
+    fassert(extra.restart > 0, "Expected positive restart");
+  }
+  // Computes dot products of vv[j] with vv[i] for i < j and itself,
+  // all reductions are fused and completed at the end of the stage.
+  static void ReduceDots(
+      const std::vector<FieldCell<Scal>>& vv, size_t j,
+      std::vector<Scal>& dots, M& m) {
+    for (size_t i = 0; i <= j; ++i) {
+      Scal sum = 0;
+      for (auto c : m.Cells()) {
+        sum += vv[j][c] * vv[i][c];
+      }
+      dots[i] = sum;
+      m.ReduceDeferred(&dots[i], Reduction::sum);
+    }
+    m.WaitReduce();
+  }
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    const size_t nr = extra.restart;
+    struct {
+      FieldCell<Scal> fcx; // solution
+      std::vector<FieldCell<Scal>> vv; // orthonormal basis of Krylov space
+      std::vector<FieldCell<Scal>> vz; // preconditioned basis
+      FieldCell<Scal> fcw; // buffer
+      // Hessenberg matrix, hh[i][j] is row i, column j
+      std::vector<std::vector<Scal>> hh;
+      std::vector<std::vector<Scal>> rr; // hh reduced by Givens rotations
+      std::vector<Scal> cs; // cosines of Givens rotations
+      std::vector<Scal> sn; // sines of Givens rotations
+      std::vector<Scal> g; // right-hand side of least squares problem
+      std::vector<Scal> dots; // dot products of new vector
+      Scal beta; // residual norm at restart
+      size_t j = 0; // index of new vector
+
+      int iter = 0;
+      Info info;
+    } * ctx(sem);
+    auto& t = *ctx;
+    const bool precond = bool(extra.precond);
+    // Adds the correction from the current Krylov space to x
+    // and returns the coefficients.
+    auto update_x = [&]() {
+      const size_t n = t.j;
+      std::vector<Scal> y(n);
+      for (size_t i = n; i-- > 0;) {
+        Scal a = t.g[i];
+        for (size_t k = i + 1; k < n; ++k) {
+          a -= t.rr[i][k] * y[k];
+        }
+        y[i] = a / (t.rr[i][i] + 1e-100);
+      }
+      const auto& basis = (precond ? t.vz : t.vv);
+      for (size_t i = 0; i < n; ++i) {
+        for (auto c : m.Cells()) {
+          t.fcx[c] += y[i] * basis[i][c];
+        }
+      }
+      return y;
+    };
+    // Starts a new Krylov space from the residual in vv[0] of norm beta
+    auto restart = [&]() {
+      for (auto c : m.Cells()) {
+        t.vv[0][c] /= (t.beta + 1e-100);
+      }
+      std::fill(t.g.begin(), t.g.end(), 0);
+      t.g[0] = t.beta;
+      t.j = 0;
+      if (!precond) {
+        m.Comm(&t.vv[0], M::CommStencil::direct_one);
+      }
+    };
+    if (sem("init")) {
+      if (fc_init) {
+        t.fcx = *fc_init;
+      } else {
+        t.fcx.Reinit(m, 0);
+      }
+      t.vv.resize(nr + 1);
+      for (auto& fc : t.vv) {
+        fc.Reinit(m, 0);
+      }
+      if (precond) {
+        t.vz.resize(nr);
+        for (auto& fc : t.vz) {
+          fc.Reinit(m, 0);
+        }
+      }
+      t.fcw.Reinit(m, 0);
+      t.hh.assign(nr + 1, std::vector<Scal>(nr, 0));
+      t.rr = t.hh;
+      t.cs.assign(nr, 0);
+      t.sn.assign(nr, 0);
+      t.g.assign(nr + 1, 0);
+      t.dots.assign(nr + 1, 0);
+      auto& fcr = t.vv[0];
+      t.beta = 0;
+      ComputeResidual(fc_system, t.fcx, fcr, m);
+      for (auto c : m.Cells()) {
+        t.beta += sqr(fcr[c]);
+      }
+      m.Reduce(&t.beta, Reduction::sum);
+    }
+    if (sem("init")) {
+      t.beta = std::sqrt(t.beta);
+      restart();
+    }
+    if (precond) {
+      if (sem.Nested("setup")) {
+        extra.precond->Setup(fc_system, m);
+      }
+    }
+    sem.LoopBegin();
+    if (precond) {
+      if (sem.Nested("precond")) {
+        extra.precond->Apply(t.vv[t.j], t.vz[t.j], m);
+      }
+      if (sem("halo")) {
+        m.Comm(&t.vz[t.j], M::CommStencil::direct_one);
+      }
+    }
+    if (sem("arnoldi")) {
+      const size_t j = t.j;
+      ApplyLinear(
+          fc_system, (precond ? t.vz[j] : t.vv[j]), t.vv[j + 1], m);
+      ReduceDots(t.vv, j + 1, t.dots, m);
+    }
+    if (sem("reorthogonalize")) {
+      const size_t j = t.j;
+      auto& w = t.vv[j + 1];
+      for (size_t i = 0; i <= j; ++i) {
+        t.hh[i][j] = t.dots[i];
+        for (auto c : m.Cells()) {
+          w[c] -= t.dots[i] * t.vv[i][c];
+        }
+      }
+      ReduceDots(t.vv, j + 1, t.dots, m);
+    }
+    if (sem("update")) {
+      const size_t j = t.j;
+      auto& w = t.vv[j + 1];
+      // norm of w after orthogonalization
+      Scal norm2 = t.dots[j + 1];
+      for (size_t i = 0; i <= j; ++i) {
+        t.hh[i][j] += t.dots[i];
+        norm2 -= sqr(t.dots[i]);
+        for (auto c : m.Cells()) {
+          w[c] -= t.dots[i] * t.vv[i][c];
+        }
+      }
+      const Scal norm = std::sqrt(std::max(norm2, Scal(0)));
+      t.hh[j + 1][j] = norm;
+      for (auto c : m.Cells()) {
+        w[c] /= (norm + 1e-100);
+      }
+      // Apply Givens rotations to the new column
+      auto& rr = t.rr;
+      for (size_t i = 0; i <= j + 1; ++i) {
+        rr[i][j] = t.hh[i][j];
+      }
+      for (size_t i = 0; i < j; ++i) {
+        const Scal a = t.cs[i] * rr[i][j] + t.sn[i] * rr[i + 1][j];
+        rr[i + 1][j] = -t.sn[i] * rr[i][j] + t.cs[i] * rr[i + 1][j];
+        rr[i][j] = a;
+      }
+      const Scal denom = std::hypot(rr[j][j], rr[j + 1][j]);
+      t.cs[j] = (denom > 0 ? rr[j][j] / denom : 1);
+      t.sn[j] = (denom > 0 ? rr[j + 1][j] / denom : 0);
+      rr[j][j] = denom;
+      rr[j + 1][j] = 0;
+      t.g[j + 1] = -t.sn[j] * t.g[j];
+      t.g[j] = t.cs[j] * t.g[j];
+      ++t.j;
+      ++t.iter;
+
+      t.info.residual = std::abs(t.g[t.j]) / std::sqrt(m.GetCellSize().prod());
+      t.info.iter = t.iter;
+      const bool done =
+          (t.iter >= conf.miniter &&
+           (t.iter > conf.maxiter || t.info.residual < conf.tol));
+      if (done) {
+        update_x();
+        sem.LoopBreak();
+      } else if (t.j == nr) {
+        const auto y = update_x();
+        // residual from the Krylov space without applying the operator
+        //   r = V (beta e_1 - H y)
+        for (auto c : m.Cells()) {
+          t.fcw[c] = 0;
+        }
+        for (size_t i = 0; i <= nr; ++i) {
+          Scal a = (i == 0 ? t.beta : 0);
+          for (size_t k = 0; k < nr; ++k) {
+            a -= t.hh[i][k] * y[k];
+          }
+          for (auto c : m.Cells()) {
+            t.fcw[c] += a * t.vv[i][c];
+          }
+        }
+        t.vv[0].swap(t.fcw);
+        t.beta = std::abs(t.g[nr]);
+        restart();
+      } else if (!precond) {
+        m.Comm(&t.vv[t.j], M::CommStencil::direct_one);
+      }
+    }
+    sem.LoopEnd();
+    if (sem("result")) {
+      fc_sol = t.fcx;
+      m.Comm(&fc_sol, M::CommStencil::direct_one);
+      if (m.flags.linreport && m.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(gmres) '" + fc_system.GetName() + "':"
+                  << " res=" << t.info.residual << " iter=" << t.info.iter
+                  << std::endl;
+      }
+    }
+    if (sem()) {
+    }
+    return t.info;
+  }
+
+ private:
+  Owner* owner_;
+  Conf& conf;
+  Extra extra;
+};
+
+template <class M>
+SolverGmres<M>::SolverGmres(const Conf& conf_, const Extra& extra, const M& m)
+    : Base(conf_), imp(new Imp(this, extra, m)) {}
+
+template <class M>
+SolverGmres<M>::~SolverGmres() = default;
+
+template <class M>
+auto SolverGmres<M>::Solve(
+    const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(fc_system, fc_init, fc_sol, m);
+}
+
+template <class M>
+class ModuleLinearGmres : public ModuleLinear<M> {
+ public:
+  ModuleLinearGmres() : ModuleLinear<M>("gmres") {}
+  std::unique_ptr<Solver<M>> Make(
+      const Vars& var, std::string prefix, const M& m) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    // Residual is estimated from the least-squares problem in L2-norm
+    fassert(
+        !var.Int(addprefix("maxnorm"), 0),
+        addprefix("maxnorm") + "=1 is not supported by gmres");
+    typename SolverGmres<M>::Extra extra;
+    extra.restart = var.Int(addprefix("restart"), extra.restart);
+    extra.precond = MakePrecond(var, prefix, m);
+    return std::make_unique<SolverGmres<M>>(
+        this->GetConf(var, prefix), extra, m);
+  }
+};
+
+} // namespace linear
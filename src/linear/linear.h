@@ -4,6 +4,7 @@
 #pragma once
 
 #include <memory>
+#include <string>
 
 #include "debug/linear.h"
 #include "geom/mesh.h"
@@ -12,6 +13,129 @@
 
 namespace linear {
 
+// Linear system with symmetric coefficients stored on faces
+//   diag[c] * x[c] + sum_q(coeff[f(q)] * x[c(q)]) + rhs[c] = 0
+// where f(q) and c(q) are the face and the neighbor cell in direction q.
+// Stores dim + 2 scalars per cell instead of 2 * dim + 2 in FieldCell<Expr>.
+template <class M>
+struct SystemFaces {
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  FieldCell<Scal> fc_diag;
+  FieldFace<Scal> ff_coeff;
+  FieldCell<Scal> fc_rhs;
+
+  // Returns coefficients of linear expression in cell c.
+  Expr GetExpr(IdxCell c, const M& m) const {
+    Expr e(0);
+    e[0] = fc_diag[c];
+    for (auto q : m.Nci(c)) {
+      e[1 + q.raw()] = ff_coeff[m.GetFace(c, q)];
+    }
+    e.back() = fc_rhs[c];
+    return e;
+  }
+  // Returns system in inner cells as coefficients of linear expressions.
+  FieldCell<Expr> ToExpr(const M& m) const {
+    FieldCell<Expr> fc_system(m, Expr(0));
+    for (auto c : m.Cells()) {
+      fc_system[c] = GetExpr(c, m);
+    }
+    fc_system.SetName(fc_diag.GetName());
+    return fc_system;
+  }
+  // Returns system with coefficients of expressions in inner cells,
+  // assumes the coefficients are symmetric.
+  static SystemFaces FromExpr(const FieldCell<Expr>& fc_system, const M& m) {
+    SystemFaces sys;
+    sys.fc_diag.Reinit(m, 0);
+    sys.ff_coeff.Reinit(m, 0);
+    sys.fc_rhs.Reinit(m, 0);
+    for (auto c : m.Cells()) {
+      const auto& e = fc_system[c];
+      sys.fc_diag[c] = e[0];
+      for (auto q : m.Nci(c)) {
+        sys.ff_coeff[m.GetFace(c, q)] = e[1 + q.raw()];
+      }
+      sys.fc_rhs[c] = e.back();
+    }
+    sys.fc_diag.SetName(fc_system.GetName());
+    return sys;
+  }
+};
+
+// Returns the linear part of the system applied to field u in cell c.
+template <class M>
+typename M::Scal ApplyLinear(
+    const FieldCell<typename M::Expr>& fc_system,
+    const FieldCell<typename M::Scal>& fcu, IdxCell c, const M& m) {
+  const auto& e = fc_system[c];
+  auto a = fcu[c] * e[0];
+  for (auto q : m.Nci(c)) {
+    a += fcu[m.GetCell(c, q)] * e[1 + q.raw()];
+  }
+  return a;
+}
+template <class M>
+typename M::Scal ApplyLinear(
+    const SystemFaces<M>& sys, const FieldCell<typename M::Scal>& fcu,
+    IdxCell c, const M& m) {
+  auto a = fcu[c] * sys.fc_diag[c];
+  for (auto q : m.Nci(c)) {
+    a += fcu[m.GetCell(c, q)] * sys.ff_coeff[m.GetFace(c, q)];
+  }
+  return a;
+}
+// Returns the constant term of the system in cell c.
+template <class Expr>
+auto GetConstant(const FieldCell<Expr>& fc_system, IdxCell c) {
+  return fc_system[c].back();
+}
+template <class M>
+auto GetConstant(const SystemFaces<M>& sys, IdxCell c) {
+  return sys.fc_rhs[c];
+}
+// Returns coefficients of the linear expression in cell c.
+template <class M>
+auto GetExpr(
+    const FieldCell<typename M::Expr>& fc_system, IdxCell c, const M&) {
+  return fc_system[c];
+}
+template <class M>
+auto GetExpr(const SystemFaces<M>& sys, IdxCell c, const M& m) {
+  return sys.GetExpr(c, m);
+}
+// Returns name of the system for reports.
+template <class Expr>
+std::string GetName(const FieldCell<Expr>& fc_system) {
+  return fc_system.GetName();
+}
+template <class M>
+std::string GetName(const SystemFaces<M>& sys) {
+  return sys.fc_diag.GetName();
+}
+// Computes res = A u in inner cells, where A is the linear part of system.
+// System: FieldCell<Expr> or SystemFaces<M>
+template <class System, class M>
+void ApplyLinear(
+    const System& sys, const FieldCell<typename M::Scal>& fcu,
+    FieldCell<typename M::Scal>& res, const M& m) {
+  for (auto c : m.Cells()) {
+    res[c] = ApplyLinear(sys, fcu, c, m);
+  }
+}
+// Computes the residual res = -(A u + b) in inner cells.
+// System: FieldCell<Expr> or SystemFaces<M>
+template <class System, class M>
+void ComputeResidual(
+    const System& sys, const FieldCell<typename M::Scal>& fcu,
+    FieldCell<typename M::Scal>& res, const M& m) {
+  for (auto c : m.Cells()) {
+    res[c] = -(ApplyLinear(sys, fcu, c, m) + GetConstant(sys, c));
+  }
+}
+
 template <class M>
 class Solver {
  public:
@@ -45,6 +169,24 @@ class Solver {
   virtual Info Solve(
       const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
       FieldCell<Scal>& fc_sol, M& m) = 0;
+  // Solves linear system with coefficients on faces.
+  // Same as Solve(), the default implementation converts the system
+  // to FieldCell<Expr>.
+  virtual Info SolveFaces(
+      const SystemFaces<M>& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    if (sem("convert")) {
+      fc_system_faces_ = sys.ToExpr(m);
+    }
+    if (sem.Nested("solve")) {
+      info_faces_ = Solve(fc_system_faces_, fc_init, fc_sol, m);
+    }
+    if (sem("free")) {
+      FieldCell<Expr>().swap(fc_system_faces_);
+    }
+    return info_faces_;
+  }
   virtual void SetConf(const Conf& c) {
     conf = c;
   }
@@ -54,6 +196,10 @@ class Solver {
 
  protected:
   Conf conf;
+
+ private:
+  FieldCell<Expr> fc_system_faces_; // system converted by SolveFaces()
+  Info info_faces_;
 };
 
 template <class M>
@@ -75,6 +221,63 @@ class ModuleLinear : public Module<ModuleLinear<M>> {
   }
 };
 
+// Preconditioner P for iterative solvers, approximates the inverse
+// of the linear part of the system.
+template <class M>
+class Precond {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  virtual ~Precond() = default;
+  // Prepares the preconditioner for a new system.
+  // fc_system: system as in Solver::Solve(), must persist until
+  //   the next call of Setup() as long as Apply() is used
+  virtual void Setup(const FieldCell<Expr>& fc_system, M& m) = 0;
+  // Same as Setup() for system with coefficients on faces.
+  // The default implementation converts the system to FieldCell<Expr>.
+  virtual void SetupFaces(const SystemFaces<M>& sys, M& m) {
+    auto sem = m.GetSem(__func__);
+    if (sem("convert")) {
+      fc_system_faces_ = sys.ToExpr(m);
+    }
+    if (sem.Nested("setup")) {
+      Setup(fc_system_faces_, m);
+    }
+  }
+  // Computes z = P r.
+  // fc_r: residual, only inner cells are used
+  // fc_z: result in inner cells
+  virtual void Apply(
+      const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) = 0;
+
+ private:
+  FieldCell<Expr> fc_system_faces_; // system converted by SetupFaces()
+};
+
+template <class M>
+class ModulePrecond : public Module<ModulePrecond<M>> {
+ public:
+  using Module<ModulePrecond>::Module;
+  virtual std::unique_ptr<Precond<M>> Make(
+      const Vars&, std::string prefix, const M& m) = 0;
+};
+
+// Returns preconditioner selected by linsolver_<prefix>_precond
+// or nullptr if `none`.
+template <class M>
+std::shared_ptr<Precond<M>> MakePrecond(
+    const Vars& var, std::string prefix, const M& m) {
+  const auto key = "linsolver_" + prefix + "_precond";
+  const auto name = var.String(key, "none");
+  if (name == "none") {
+    return nullptr;
+  }
+  auto* mod = ModulePrecond<M>::GetInstance(name);
+  fassert(mod, "Unknown " + key + "=" + name);
+  return mod->Make(var, prefix, m);
+}
+
 template <class M>
 class SolverConjugate : public Solver<M> {
  public:
@@ -85,12 +288,19 @@ class SolverConjugate : public Solver<M> {
   using Expr = typename M::Expr;
   struct Extra {
     bool residual_max = false; // if true, use max-norm of residual, else L2
+    bool coroutine = false; // if true, run as coroutine instead of stages
+    std::shared_ptr<Precond<M>> precond; // preconditioner, nullptr for none
   };
   SolverConjugate(const Conf& conf, const Extra& extra, const M&);
   ~SolverConjugate();
   Info Solve(
       const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
       FieldCell<Scal>& fc_sol, M& m) override;
+  // Applies the system directly, the preconditioner
+  // may convert it, see Precond::SetupFaces().
+  Info SolveFaces(
+      const SystemFaces<M>& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
 
  private:
   struct Imp;
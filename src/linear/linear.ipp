@@ -9,6 +9,8 @@
 #include <vector>
 
 #include "linear.h"
+#include "util/memtrack.h"
+#include "util/sysinfo.h"
 
 DECLARE_FORCE_LINK_TARGET(linear_conjugate);
 DECLARE_FORCE_LINK_TARGET(linear_jacobi);
@@ -21,8 +23,32 @@ struct SolverConjugate<M>::Imp {
 
   Imp(Owner* owner, const Extra& extra_, const M&)
       : owner_(owner), conf(owner_->conf), extra(extra_) {}
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
   Info Solve(
-      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      const System& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    if (extra.precond) {
+      return SolvePrecond(sys, fc_init, fc_sol, m);
+    }
+    if (extra.coroutine) {
+      return SolveCoroutine(sys, fc_init, fc_sol, m);
+    }
+    return SolvePlain(sys, fc_init, fc_sol, m);
+  }
+  static void SetupPrecond(
+      Precond<M>& precond, const FieldCell<Expr>& fc_system, M& m) {
+    precond.Setup(fc_system, m);
+  }
+  static void SetupPrecond(
+      Precond<M>& precond, const SystemFaces<M>& sys, M& m) {
+    precond.SetupFaces(sys, m);
+  }
+  // Conjugate gradients without preconditioner.
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
+  Info SolvePlain(
+      const System& sys, const FieldCell<Scal>* fc_init,
       FieldCell<Scal>& fc_sol, M& m) {
     auto sem = m.GetSem(__func__);
     struct {
@@ -46,14 +72,7 @@ struct SolverConjugate<M>::Imp {
         t.fcu.Reinit(m, 0);
       }
       t.fcr.Reinit(m);
-      for (auto c : m.Cells()) {
-        const auto& e = fc_system[c];
-        Scal u = t.fcu[c] * e[0] + e.back();
-        for (auto q : m.Nci(c)) {
-          u += t.fcu[m.GetCell(c, q)] * e[1 + q.raw()];
-        }
-        t.fcr[c] = -u;
-      }
+      ComputeResidual(sys, t.fcu, t.fcr, m);
       m.Comm(&t.fcr, M::CommStencil::direct_one);
     }
     if (sem("init")) {
@@ -62,14 +81,7 @@ struct SolverConjugate<M>::Imp {
     }
     sem.LoopBegin();
     if (sem("iter")) {
-      for (auto c : m.Cells()) {
-        const auto& e = fc_system[c];
-        Scal p = t.fcp[c] * e[0];
-        for (auto q : m.Nci(c)) {
-          p += t.fcp[m.GetCell(c, q)] * e[1 + q.raw()];
-        }
-        t.fclp[c] = p;
-      }
+      ApplyLinear(sys, t.fcp, t.fclp, m);
 
       t.dot_r_prev = 0;
       t.dot_p_lp = 0;
@@ -91,9 +103,11 @@ struct SolverConjugate<M>::Imp {
         t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
       }
       m.Reduce(&t.dot_r, Reduction::sum);
-      m.Reduce(&t.max_r, Reduction::max);
+      // only needed in "check", overlapped with "iter3"
+      m.ReduceDeferred(&t.max_r, Reduction::max);
     }
     if (sem("iter3")) {
+      m.WaitReduce();
       for (auto c : m.Cells()) {
         t.fcp[c] = t.fcr[c] + (t.dot_r / (t.dot_r_prev + 1e-100)) * t.fcp[c];
       }
@@ -118,7 +132,133 @@ struct SolverConjugate<M>::Imp {
       m.Comm(&fc_sol, M::CommStencil::direct_one);
       if (m.flags.linreport && m.IsRoot()) {
         std::cerr << std::scientific;
-        std::cerr << "linear(conjugate) '" + fc_system.GetName() + "':"
+        std::cerr << "linear(conjugate) '" + GetName(sys) + "':"
+                  << " res=" << t.info.residual << " iter=" << t.info.iter
+                  << std::endl;
+      }
+    }
+    if (sem()) {
+    }
+    return t.info;
+  }
+  // Conjugate gradients with preconditioner extra.precond.
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
+  Info SolvePrecond(
+      const System& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    struct {
+      FieldCell<Scal> fcu;
+      FieldCell<Scal> fcr;
+      FieldCell<Scal> fcz; // preconditioned residual
+      FieldCell<Scal> fcz_prev;
+      FieldCell<Scal> fcp;
+      FieldCell<Scal> fclp; // linear fc_system operator applied to p
+      Scal dot_p_lp;
+      Scal dot_rz;
+      Scal dot_rz_prev; // dot product of r and previous z
+      Scal dot_rz_old; // dot_rz from previous iteration
+      Scal dot_r;
+      Scal max_r;
+
+      int iter = 0;
+      Info info;
+    } * ctx(sem);
+    auto& t = *ctx;
+    auto& precond = *extra.precond;
+    if (sem("init")) {
+      if (fc_init) {
+        t.fcu = *fc_init;
+      } else {
+        t.fcu.Reinit(m, 0);
+      }
+      t.fcr.Reinit(m, 0);
+      ComputeResidual(sys, t.fcu, t.fcr, m);
+    }
+    if (sem.Nested("setup")) {
+      SetupPrecond(precond, sys, m);
+    }
+    if (sem.Nested("precond")) {
+      precond.Apply(t.fcr, t.fcz, m);
+    }
+    if (sem("init")) {
+      t.fcp.Reinit(m, 0);
+      t.dot_rz = 0;
+      for (auto c : m.Cells()) {
+        t.fcp[c] = t.fcz[c];
+        t.dot_rz += t.fcr[c] * t.fcz[c];
+      }
+      m.Reduce(&t.dot_rz, Reduction::sum);
+      m.Comm(&t.fcp, M::CommStencil::direct_one);
+      t.fclp.Reinit(m);
+    }
+    sem.LoopBegin();
+    if (sem("iter")) {
+      t.dot_p_lp = 0;
+      for (auto c : m.Cells()) {
+        t.fclp[c] = ApplyLinear(sys, t.fcp, c, m);
+        t.dot_p_lp += t.fcp[c] * t.fclp[c];
+      }
+      m.Reduce(&t.dot_p_lp, Reduction::sum);
+    }
+    if (sem("iter2")) {
+      const Scal alpha = t.dot_rz / (t.dot_p_lp + 1e-100);
+      for (auto c : m.Cells()) {
+        t.fcu[c] += alpha * t.fcp[c];
+        t.fcr[c] -= alpha * t.fclp[c];
+      }
+      t.fcz_prev.swap(t.fcz);
+    }
+    if (sem.Nested("precond")) {
+      precond.Apply(t.fcr, t.fcz, m);
+    }
+    if (sem("iter3")) {
+      t.dot_rz_old = t.dot_rz;
+      t.dot_rz = 0;
+      t.dot_rz_prev = 0;
+      t.dot_r = 0;
+      t.max_r = 0;
+      for (auto c : m.Cells()) {
+        t.dot_rz += t.fcr[c] * t.fcz[c];
+        t.dot_rz_prev += t.fcr[c] * t.fcz_prev[c];
+        t.dot_r += sqr(t.fcr[c]);
+        t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
+      }
+      m.Reduce(&t.dot_rz, Reduction::sum);
+      m.Reduce(&t.dot_rz_prev, Reduction::sum);
+      m.Reduce(&t.dot_r, Reduction::sum);
+      m.Reduce(&t.max_r, Reduction::max);
+    }
+    if (sem("iter4")) {
+      // flexible variant, the preconditioner may change between iterations
+      const Scal beta =
+          (t.dot_rz - t.dot_rz_prev) / (t.dot_rz_old + 1e-100);
+      for (auto c : m.Cells()) {
+        t.fcp[c] = t.fcz[c] + beta * t.fcp[c];
+      }
+      m.Comm(&t.fcp, M::CommStencil::direct_one);
+    }
+    if (sem("check")) {
+      if (extra.residual_max) {
+        t.info.residual = t.max_r / m.GetCellSize().prod();
+      } else { // L2-norm
+        t.info.residual = std::sqrt(t.dot_r / m.GetCellSize().prod());
+      }
+      ++t.iter;
+      t.info.iter = t.iter;
+      if (t.iter >= conf.miniter &&
+          (t.iter > conf.maxiter || t.info.residual < conf.tol)) {
+        sem.LoopBreak();
+      }
+    }
+    sem.LoopEnd();
+    if (sem("result")) {
+      fc_sol = t.fcu;
+      m.Comm(&fc_sol, M::CommStencil::direct_one);
+      if (m.flags.linreport && m.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(conjugate,precond) '" + GetName(sys) + "':"
                   << " res=" << t.info.residual << " iter=" << t.info.iter
                   << std::endl;
       }
@@ -127,6 +267,98 @@ struct SolverConjugate<M>::Imp {
     }
     return t.info;
   }
+  // Same algorithm as SolvePlain() in one stage executed as coroutine.
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
+  Info SolveCoroutine(
+      const System& system_ref, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    struct {
+      Info info;
+    } * ctx(sem);
+    auto* info = &ctx->info;
+    auto* system = &system_ref;
+    auto* sol = &fc_sol;
+    auto* mesh = &m;
+    sem.Coroutine([this, info, system, fc_init, sol, mesh](Coroutine& co) {
+      auto& mm = *mesh;
+      const auto& sys = *system;
+      FieldCell<Scal> fcu;
+      if (fc_init) {
+        fcu = *fc_init;
+      } else {
+        fcu.Reinit(mm, 0);
+      }
+      FieldCell<Scal> fcr(mm);
+      ComputeResidual(sys, fcu, fcr, mm);
+      mm.Comm(&fcr, M::CommStencil::direct_one);
+      co.Yield();
+
+      FieldCell<Scal> fcp = fcr;
+      FieldCell<Scal> fclp(mm); // linear sys operator applied to p
+      Scal dot_p_lp;
+      Scal dot_r;
+      Scal dot_r_prev;
+      Scal max_r;
+      int iter = 0;
+      while (true) {
+        ApplyLinear(sys, fcp, fclp, mm);
+        dot_r_prev = 0;
+        dot_p_lp = 0;
+        for (auto c : mm.Cells()) {
+          dot_r_prev += sqr(fcr[c]);
+          dot_p_lp += fcp[c] * fclp[c];
+        }
+        mm.Reduce(&dot_r_prev, Reduction::sum);
+        mm.Reduce(&dot_p_lp, Reduction::sum);
+        co.Yield();
+
+        const Scal alpha = dot_r_prev / (dot_p_lp + 1e-100);
+        dot_r = 0;
+        max_r = 0;
+        for (auto c : mm.Cells()) {
+          fcu[c] += alpha * fcp[c];
+          fcr[c] -= alpha * fclp[c];
+          dot_r += sqr(fcr[c]);
+          max_r = std::max(max_r, std::abs(fcr[c]));
+        }
+        mm.Reduce(&dot_r, Reduction::sum);
+        mm.ReduceDeferred(&max_r, Reduction::max);
+        co.Yield();
+
+        for (auto c : mm.Cells()) {
+          fcp[c] = fcr[c] + (dot_r / (dot_r_prev + 1e-100)) * fcp[c];
+        }
+        mm.Comm(&fcp, M::CommStencil::direct_one);
+        mm.WaitReduce();
+        co.Yield();
+
+        if (extra.residual_max) {
+          info->residual = max_r / mm.GetCellSize().prod();
+        } else { // L2-norm
+          info->residual = std::sqrt(dot_r / mm.GetCellSize().prod());
+        }
+        ++iter;
+        info->iter = iter;
+        if (iter >= conf.miniter &&
+            (iter > conf.maxiter || info->residual < conf.tol)) {
+          break;
+        }
+      }
+
+      *sol = fcu;
+      mm.Comm(sol, M::CommStencil::direct_one);
+      co.Yield();
+      if (mm.flags.linreport && mm.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(conjugate) '" + GetName(sys) + "':"
+                  << " res=" << info->residual << " iter=" << info->iter
+                  << std::endl;
+      }
+    });
+    return ctx->info;
+  }
 
  private:
   Owner* owner_;
@@ -146,9 +378,18 @@ template <class M>
 auto SolverConjugate<M>::Solve(
     const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
     FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
   return imp->Solve(fc_system, fc_init, fc_sol, m);
 }
 
+template <class M>
+auto SolverConjugate<M>::SolveFaces(
+    const SystemFaces<M>& sys, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(sys, fc_init, fc_sol, m);
+}
+
 template <class M>
 struct SolverJacobi<M>::Imp {
   using Owner = SolverJacobi<M>;
@@ -233,6 +474,7 @@ template <class M>
 auto SolverJacobi<M>::Solve(
     const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
     FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
   return imp->Solve(fc_system, fc_init, fc_sol, m);
 }
 
@@ -247,6 +489,25 @@ class ModuleLinearConjugate : public ModuleLinear<M> {
     };
     typename linear::SolverConjugate<M>::Extra extra;
     extra.residual_max = var.Int[addprefix("maxnorm")];
+    extra.coroutine = var.Int(addprefix("coroutine"), 0);
+    extra.precond = MakePrecond(var, prefix, m);
+    fassert(
+        !extra.precond || !extra.coroutine,
+        addprefix("precond") + " is not supported with " +
+            addprefix("coroutine"));
+    // Coroutine must be resumed on the thread that started it,
+    // so with multiple threads each block must stay on one thread
+    if (extra.coroutine) {
+      fassert(
+          !var.Int("openmp_steal", 0),
+          addprefix("coroutine") + " is not supported with openmp_steal");
+      const auto info = sysinfo::GetInfo({false, true, false});
+      fassert(
+          info.omp_max_threads == 1 || var.Int("openmp_numa", 0),
+          addprefix("coroutine") + " with " +
+              std::to_string(info.omp_max_threads) +
+              " threads requires openmp_numa=1");
+    }
     return std::make_unique<linear::SolverConjugate<M>>(
         this->GetConf(var, prefix), extra, m);
   }
@@ -8,6 +8,7 @@
 
 #include "hypre.h"
 #include "linear_hypre.h"
+#include "util/memtrack.h"
 
 DECLARE_FORCE_LINK_TARGET(linear_hypre);
 
@@ -172,6 +173,7 @@ template <class M>
 auto SolverHypre<M>::Solve(
     const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
     FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
   return imp->Solve(fc_system, fc_init, fc_sol, m);
 }
 
@@ -0,0 +1,26 @@
+// Created by Petr Karnakov on 02.04.2021
+// Copyright 2021 ETH Zurich
+
+#include "multigrid.ipp"
+
+namespace linear {
+
+#define X(dim) template class Multigrid<MeshCartesian<double, dim>>;
+MULTIDIMX
+#undef X
+
+#define X(dim) template class SolverMultigrid<MeshCartesian<double, dim>>;
+MULTIDIMX
+#undef X
+
+#define X(dim) \
+  RegisterModule<ModuleLinearMultigrid<MeshCartesian<double, dim>>>(),
+bool kReg_multigrid[] = {MULTIDIMX};
+#undef X
+
+#define X(dim) \
+  RegisterModule<ModulePrecondMultigrid<MeshCartesian<double, dim>>>(),
+bool kReg_precond_multigrid[] = {MULTIDIMX};
+#undef X
+
+} // namespace linear
@@ -0,0 +1,101 @@
+// Created by Petr Karnakov on 02.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "linear.h"
+
+namespace linear {
+
+// V-cycle of aggregation multigrid for systems on a Cartesian mesh.
+// Coarse levels are built by aggregating 2x2x2 cells within each block
+// until one aggregate covers the block (or the block size is not
+// divisible by two). Coarse systems are Galerkin products with
+// piecewise constant prolongation and computed locally in each block.
+// The coarsest system is assembled from partial sums over all blocks
+// and ranks and solved on the root block with conjugate gradients.
+// If the last level has more than `coarse_max` cells in total,
+// it is smoothed and its cells are aggregated across blocks
+// by factors of two (while the global size is divisible) into
+// at most `coarse_max` cells of the coarsest system.
+// Halo values of coarse levels are exchanged through a field
+// on the fine mesh, so all communication is done by m.Comm().
+template <class M>
+class Multigrid {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  struct Conf {
+    int nsmooth = 2; // pre- and post-smoothing sweeps
+    std::string smoother = "jacobi"; // "jacobi" or "chebyshev"
+    Scal omega = 0.8; // relaxation factor of Jacobi smoother
+    // lower bound of Chebyshev interval relative to the upper bound
+    Scal chebyshev_ratio = 0.3;
+    // factor of coarse-grid correction, values above 1 compensate
+    // for the piecewise constant prolongation
+    Scal correction = 1.8;
+    int max_levels = 100; // maximum number of levels including the finest
+    Scal coarse_tol = 1e-6; // tolerance of coarsest solve relative to rhs
+    int coarse_maxiter = 1000; // maximum iterations of coarsest solve
+    int coarse_max = 512; // maximum size of coarsest system
+  };
+
+  Multigrid(const Conf& conf, const M& m);
+  ~Multigrid();
+  // Builds coarse levels from the linear part of the system.
+  // fc_system: system as in Solver::Solve(), must persist until
+  //   the next call of Setup() as long as Cycle() is used
+  void Setup(const FieldCell<Expr>& fc_system, M& m);
+  // Same as Setup() for system with coefficients on faces.
+  void Setup(const SystemFaces<M>& sys, M& m);
+  // Applies one V-cycle with zero initial guess
+  // to approximate the solution of A * z = r
+  // where A is the linear part of the system.
+  // fc_r: right-hand side
+  // fc_z: approximate solution, including halo cells adjacent to faces
+  void Cycle(const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m);
+  // Returns number of levels including the finest
+  int GetNumLevels() const;
+  // Reads options linsolver_<prefix>_mg_*
+  static Conf GetConf(const Vars& var, std::string prefix);
+
+ private:
+  struct Imp;
+  std::unique_ptr<Imp> imp;
+};
+
+template <class M>
+class SolverMultigrid : public Solver<M> {
+ public:
+  using Base = Solver<M>;
+  using Conf = typename Base::Conf;
+  using Info = typename Base::Info;
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+  struct Extra {
+    bool residual_max = false; // if true, use max-norm of residual, else L2
+    // if true, use V-cycle as preconditioner of conjugate gradients,
+    // else apply V-cycles as stationary iterations
+    bool cg = true;
+    typename Multigrid<M>::Conf mg;
+  };
+  SolverMultigrid(const Conf& conf, const Extra& extra, const M&);
+  ~SolverMultigrid();
+  Info Solve(
+      const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
+  // Builds levels and applies the system directly without conversion.
+  Info SolveFaces(
+      const SystemFaces<M>& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) override;
+
+ private:
+  struct Imp;
+  const std::unique_ptr<Imp> imp;
+};
+
+} // namespace linear
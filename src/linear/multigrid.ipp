@@ -0,0 +1,783 @@
+// Created by Petr Karnakov on 02.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+#include <limits>
+#include <vector>
+
+#include "multigrid.h"
+#include "util/memtrack.h"
+
+DECLARE_FORCE_LINK_TARGET(linear_multigrid);
+
+namespace linear {
+
+template <class M>
+struct Multigrid<M>::Imp {
+  using Owner = Multigrid<M>;
+  using MIdx = typename M::MIdx;
+  static constexpr size_t dim = M::dim;
+  static constexpr size_t kNone = std::numeric_limits<size_t>::max();
+
+  // Cells of one level in one block with one layer of halo cells.
+  // Arrays are indexed by position in the padded block.
+  struct Level {
+    MIdx size; // number of inner cells
+    MIdx scale; // number of fine cells in one cell of this level
+    MIdx stride; // strides of padded arrays
+    std::array<std::ptrdiff_t, dim * 2> offset; // offset to neighbor `q`
+    std::vector<size_t> cells; // inner cells
+    std::vector<MIdx> cells_w; // position of inner cells
+    std::vector<size_t> parent; // cell of next level or kNone for halos
+    // Halo exchange through fine field:
+    // inner cells at block boundary and fine inner cells to write,
+    // halo cells and fine halo cells to read
+    std::vector<std::pair<size_t, IdxCell>> send;
+    std::vector<std::pair<size_t, IdxCell>> recv;
+    std::vector<Expr> system; // only linear part is used
+    std::vector<Scal> u; // solution
+    std::vector<Scal> rhs; // right-hand side
+    std::vector<Scal> tmp; // new solution or Chebyshev direction
+    Scal lmax; // upper bound of eigenvalues of D^{-1} A
+    Scal rho; // Chebyshev recurrence coefficient
+
+    size_t GetIdx(MIdx w) const {
+      size_t res = 0;
+      for (size_t d = 0; d < dim; ++d) {
+        res += (w[d] + 1) * stride[d];
+      }
+      return res;
+    }
+    size_t GetPaddedSize() const {
+      return (size + MIdx(2)).prod();
+    }
+    // Returns linear part of the system applied to u in cell i
+    Scal Apply(size_t i) const {
+      const Expr& e = system[i];
+      Scal res = e[0] * u[i];
+      for (size_t q = 0; q < dim * 2; ++q) {
+        res += e[1 + q] * u[i + offset[q]];
+      }
+      return res;
+    }
+  };
+
+  Imp(Owner* owner, const Conf& conf, const M& m)
+      : owner_(owner), conf_(conf), fc_buf_(m, 0) {
+    const MIdx bs = m.GetInBlockCells().GetSize();
+    MIdx scale(1);
+    while (true) {
+      levels_.emplace_back();
+      InitLevel(levels_.back(), scale, m);
+      if (int(levels_.size()) >= conf_.max_levels) {
+        break;
+      }
+      MIdx next = scale;
+      for (size_t d = 0; d < dim; ++d) {
+        if ((bs[d] / scale[d]) % 2 == 0) {
+          next[d] *= 2;
+        }
+      }
+      if (next == scale) {
+        break;
+      }
+      scale = next;
+    }
+    for (size_t l = 0; l + 1 < levels_.size(); ++l) {
+      auto& lv = levels_[l];
+      const auto& lc = levels_[l + 1];
+      const MIdx ratio = lc.scale / lv.scale;
+      lv.parent.assign(lv.GetPaddedSize(), size_t(kNone));
+      for (size_t k = 0; k < lv.cells.size(); ++k) {
+        lv.parent[lv.cells[k]] = lc.GetIdx(lv.cells_w[k] / ratio);
+      }
+    }
+    // Aggregates of the last level over blocks and ranks
+    const auto& lc = levels_.back();
+    const MIdx global_size = m.GetGlobalSize() / lc.scale;
+    MIdx ratio(1);
+    while (size_t((global_size / ratio).prod()) > size_t(conf_.coarse_max)) {
+      const MIdx prev = ratio;
+      for (size_t d = 0; d < dim; ++d) {
+        if ((global_size[d] / ratio[d]) % 2 == 0) {
+          ratio[d] *= 2;
+        }
+      }
+      if (ratio == prev) {
+        break;
+      }
+    }
+    coarse_size_ = global_size / ratio;
+    coarse_aggregated_ = (ratio != MIdx(1));
+    const MIdx origin = m.GetInBlockCells().GetBegin() / lc.scale;
+    const GIndex<size_t, dim> gindex(coarse_size_);
+    for (auto w : lc.cells_w) {
+      const MIdx wg = origin + w;
+      coarse_index_.push_back(gindex.GetIdx(wg / ratio));
+      coarse_index_nb_.emplace_back();
+      for (size_t d = 0; d < dim; ++d) {
+        for (int side = 0; side < 2; ++side) {
+          MIdx wn = wg;
+          wn[d] = (wn[d] + (side ? 1 : -1) + global_size[d]) % global_size[d];
+          coarse_index_nb_.back()[2 * d + side] = gindex.GetIdx(wn / ratio);
+        }
+      }
+    }
+    const MIdx begin = m.GetInBlockCells().GetBegin();
+    for (auto w : levels_[0].cells_w) {
+      finecells_.push_back(m.GetIndexCells().GetIdx(begin + w));
+    }
+  }
+  void InitLevel(Level& lv, MIdx scale, const M& m) {
+    const MIdx bs = m.GetInBlockCells().GetSize();
+    const MIdx begin = m.GetInBlockCells().GetBegin();
+    const auto& indexc = m.GetIndexCells();
+    lv.scale = scale;
+    lv.size = bs / scale;
+    lv.stride[0] = 1;
+    for (size_t d = 1; d < dim; ++d) {
+      lv.stride[d] = lv.stride[d - 1] * (lv.size[d - 1] + 2);
+    }
+    for (size_t d = 0; d < dim; ++d) {
+      lv.offset[2 * d] = -std::ptrdiff_t(lv.stride[d]);
+      lv.offset[2 * d + 1] = lv.stride[d];
+    }
+    for (auto w : GBlock<size_t, dim>(lv.size)) {
+      lv.cells.push_back(lv.GetIdx(w));
+      lv.cells_w.push_back(w);
+      for (size_t d = 0; d < dim; ++d) {
+        for (int side = 0; side < 2; ++side) {
+          if (w[d] != (side ? lv.size[d] - 1 : 0)) {
+            continue;
+          }
+          // first fine cell of the aggregate on the block boundary
+          MIdx wf = w * scale;
+          wf[d] = (side ? bs[d] - 1 : 0);
+          MIdx wh = w;
+          wh[d] += (side ? 1 : -1);
+          MIdx wfh = wf;
+          wfh[d] += (side ? 1 : -1);
+          lv.send.emplace_back(lv.GetIdx(w), indexc.GetIdx(begin + wf));
+          lv.recv.emplace_back(lv.GetIdx(wh), indexc.GetIdx(begin + wfh));
+        }
+      }
+    }
+    const size_t np = lv.GetPaddedSize();
+    lv.system.assign(np, Expr(0));
+    lv.u.assign(np, 0);
+    lv.rhs.assign(np, 0);
+    lv.tmp.assign(np, 0);
+  }
+  void SendHalo(int l, M& m) {
+    auto& lv = levels_[l];
+    for (auto& p : lv.send) {
+      fc_buf_[p.second] = lv.u[p.first];
+    }
+    m.Comm(&fc_buf_, M::CommStencil::direct_one);
+    pending_ = l;
+  }
+  // Reads halo values requested by SendHalo() in the previous stage
+  void RecvHalo(int l) {
+    if (pending_ != l) {
+      return;
+    }
+    auto& lv = levels_[l];
+    for (auto& p : lv.recv) {
+      lv.u[p.first] = fc_buf_[p.second];
+    }
+    pending_ = -1;
+  }
+  // Builds system of level l + 1 from level l
+  void Coarsen(size_t l) {
+    const auto& lv = levels_[l];
+    auto& lc = levels_[l + 1];
+    std::fill(lc.system.begin(), lc.system.end(), Expr(0));
+    for (auto i : lv.cells) {
+      const size_t ic = lv.parent[i];
+      const Expr& e = lv.system[i];
+      Expr& ec = lc.system[ic];
+      ec[0] += e[0];
+      for (size_t q = 0; q < dim * 2; ++q) {
+        if (lv.parent[i + lv.offset[q]] == ic) {
+          ec[0] += e[1 + q];
+        } else {
+          ec[1 + q] += e[1 + q];
+        }
+      }
+    }
+  }
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
+  void Setup(const System& sys, M& m) {
+    auto sem = m.GetSem("mg-setup");
+    if (sem("local")) {
+      auto& l0 = levels_[0];
+      for (size_t k = 0; k < l0.cells.size(); ++k) {
+        l0.system[l0.cells[k]] = GetExpr(sys, finecells_[k], m);
+      }
+      for (size_t l = 0; l + 1 < levels_.size(); ++l) {
+        Coarsen(l);
+      }
+      for (auto& lv : levels_) {
+        lv.lmax = 0;
+        for (auto i : lv.cells) {
+          const Expr& e = lv.system[i];
+          Scal sum = 0;
+          for (size_t q = 0; q < dim * 2 + 1; ++q) {
+            sum += std::abs(e[q]);
+          }
+          if (e[0] != 0) {
+            lv.lmax = std::max(lv.lmax, sum / std::abs(e[0]));
+          }
+        }
+        m.Reduce(&lv.lmax, Reduction::max);
+      }
+      // Galerkin product of aggregates as in Coarsen(),
+      // partial sums of all blocks are added by the reduction
+      const auto& lc = levels_.back();
+      const size_t entry = dim * 2 + 1;
+      coarse_buf_.assign(coarse_size_.prod() * entry, 0);
+      for (size_t k = 0; k < lc.cells.size(); ++k) {
+        const Expr& e = lc.system[lc.cells[k]];
+        const size_t a = coarse_index_[k];
+        coarse_buf_[a * entry] += e[0];
+        for (size_t q = 0; q < dim * 2; ++q) {
+          const size_t an = coarse_index_nb_[k][q];
+          coarse_buf_[a * entry + (an == a ? 0 : 1 + q)] += e[1 + q];
+        }
+      }
+      m.Reduce(&coarse_buf_, Reduction::sum);
+    }
+    if (sem("root")) {
+      if (m.IsRoot()) {
+        SetupCoarse();
+      }
+    }
+  }
+  // Builds the coarsest system on the root block from coarse_buf_
+  void SetupCoarse() {
+    const MIdx global_size = coarse_size_;
+    const GIndex<size_t, dim> gindex(global_size);
+    const size_t n = global_size.prod();
+    const size_t entry = dim * 2 + 1;
+    fassert_equal(coarse_buf_.size(), n * entry);
+    coarse_system_.assign(n, Expr(0));
+    for (size_t i = 0; i < n; ++i) {
+      Expr& e = coarse_system_[i];
+      for (size_t q = 0; q < entry; ++q) {
+        e[q] = coarse_buf_[i * entry + q];
+      }
+    }
+    // Neighbors with periodic wrap,
+    // coefficients at non-periodic boundaries are zero
+    coarse_nb_.resize(n);
+    coarse_singular_ = true;
+    for (size_t i = 0; i < n; ++i) {
+      const MIdx w = gindex.GetMIdx(i);
+      for (size_t d = 0; d < dim; ++d) {
+        for (int side = 0; side < 2; ++side) {
+          MIdx wn = w;
+          wn[d] = (wn[d] + (side ? 1 : -1) + global_size[d]) % global_size[d];
+          coarse_nb_[i][2 * d + side] = gindex.GetIdx(wn);
+        }
+      }
+      const Expr& e = coarse_system_[i];
+      Scal sum = 0;
+      for (size_t q = 0; q < dim * 2 + 1; ++q) {
+        sum += e[q];
+      }
+      if (std::abs(sum) > 1e-10 * std::abs(e[0])) {
+        coarse_singular_ = false;
+      }
+    }
+  }
+  // Solves the coarsest system on the root block with conjugate gradients
+  void SolveCoarse(const std::vector<Scal>& rhs, std::vector<Scal>& sol) {
+    const size_t n = coarse_system_.size();
+    auto apply = [&](const std::vector<Scal>& u, std::vector<Scal>& res) {
+      for (size_t i = 0; i < n; ++i) {
+        const Expr& e = coarse_system_[i];
+        Scal a = e[0] * u[i];
+        for (size_t q = 0; q < dim * 2; ++q) {
+          a += e[1 + q] * u[coarse_nb_[i][q]];
+        }
+        res[i] = a;
+      }
+    };
+    auto dot = [n](const std::vector<Scal>& a, const std::vector<Scal>& b) {
+      Scal res = 0;
+      for (size_t i = 0; i < n; ++i) {
+        res += a[i] * b[i];
+      }
+      return res;
+    };
+    sol.assign(n, 0);
+    std::vector<Scal> r = rhs;
+    if (coarse_singular_) { // project to the range of the operator
+      Scal mean = 0;
+      for (auto a : r) {
+        mean += a;
+      }
+      mean /= n;
+      for (auto& a : r) {
+        a -= mean;
+      }
+    }
+    std::vector<Scal> p = r;
+    std::vector<Scal> ap(n);
+    Scal rr = dot(r, r);
+    const Scal rr0 = rr;
+    for (int iter = 0; iter < conf_.coarse_maxiter; ++iter) {
+      if (rr <= sqr(conf_.coarse_tol) * rr0 || rr == 0) {
+        break;
+      }
+      apply(p, ap);
+      const Scal alpha = rr / (dot(p, ap) + 1e-100);
+      for (size_t i = 0; i < n; ++i) {
+        sol[i] += alpha * p[i];
+        r[i] -= alpha * ap[i];
+      }
+      const Scal rr_new = dot(r, r);
+      const Scal beta = rr_new / (rr + 1e-100);
+      for (size_t i = 0; i < n; ++i) {
+        p[i] = r[i] + beta * p[i];
+      }
+      rr = rr_new;
+    }
+  }
+  // Applies sweep k of smoother on level l
+  void Smooth(size_t l, int k) {
+    auto& lv = levels_[l];
+    if (conf_.smoother == "chebyshev") {
+      const Scal b = lv.lmax;
+      const Scal a = b * conf_.chebyshev_ratio;
+      const Scal theta = (a + b) * 0.5;
+      const Scal delta = (b - a) * 0.5;
+      const Scal sigma = theta / delta;
+      auto& d = lv.tmp;
+      if (k == 0) {
+        lv.rho = 1 / sigma;
+        for (auto i : lv.cells) {
+          d[i] = (lv.rhs[i] - lv.Apply(i)) / (theta * lv.system[i][0]);
+        }
+      } else {
+        const Scal rho = 1 / (2 * sigma - lv.rho);
+        for (auto i : lv.cells) {
+          const Scal r = lv.rhs[i] - lv.Apply(i);
+          d[i] = rho * lv.rho * d[i] + 2 * rho / delta * r / lv.system[i][0];
+        }
+        lv.rho = rho;
+      }
+      for (auto i : lv.cells) {
+        lv.u[i] += d[i];
+      }
+    } else {
+      for (auto i : lv.cells) {
+        const Scal r = lv.rhs[i] - lv.Apply(i);
+        lv.tmp[i] = lv.u[i] + conf_.omega * r / lv.system[i][0];
+      }
+      lv.u.swap(lv.tmp);
+    }
+  }
+  // Restricts residual of level l to right-hand side of level l + 1
+  void Restrict(size_t l) {
+    const auto& lv = levels_[l];
+    auto& lc = levels_[l + 1];
+    std::fill(lc.rhs.begin(), lc.rhs.end(), 0);
+    std::fill(lc.u.begin(), lc.u.end(), 0);
+    for (auto i : lv.cells) {
+      lc.rhs[lv.parent[i]] += lv.rhs[i] - lv.Apply(i);
+    }
+  }
+  // Adds correction from level l + 1 to level l
+  void Prolong(size_t l) {
+    auto& lv = levels_[l];
+    const auto& lc = levels_[l + 1];
+    for (auto i : lv.cells) {
+      lv.u[i] += conf_.correction * lc.u[lv.parent[i]];
+    }
+  }
+  void Cycle(const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) {
+    auto sem = m.GetSem("mg-cycle");
+    const int nl = levels_.size();
+    // Levels with smoothing, including the last level if its cells
+    // are aggregated further for the coarsest system
+    const int ns = (coarse_aggregated_ ? nl : nl - 1);
+    if (sem("init")) {
+      auto& l0 = levels_[0];
+      std::fill(l0.u.begin(), l0.u.end(), 0);
+      for (size_t k = 0; k < l0.cells.size(); ++k) {
+        l0.rhs[l0.cells[k]] = fc_r[finecells_[k]];
+      }
+      pending_ = -1;
+    }
+    for (int l = 0; l < ns; ++l) {
+      for (int k = 0; k < conf_.nsmooth; ++k) {
+        if (sem("pre")) {
+          RecvHalo(l);
+          Smooth(l, k);
+          SendHalo(l, m);
+        }
+      }
+      if (sem("restrict")) {
+        RecvHalo(l);
+        if (l + 1 < nl) {
+          Restrict(l);
+        }
+      }
+    }
+    if (sem("coarse-gather")) {
+      // Residual of the last level summed over aggregates
+      const auto& lc = levels_.back();
+      coarse_buf_.assign(coarse_size_.prod(), 0);
+      for (size_t k = 0; k < lc.cells.size(); ++k) {
+        const size_t i = lc.cells[k];
+        coarse_buf_[coarse_index_[k]] += lc.rhs[i] - lc.Apply(i);
+      }
+      m.Reduce(&coarse_buf_, Reduction::sum);
+    }
+    if (sem("coarse-solve")) {
+      if (m.IsRoot()) {
+        SolveCoarse(coarse_buf_, coarse_sol_);
+      }
+      m.Bcast(&coarse_sol_);
+    }
+    if (sem("coarse-scatter")) {
+      auto& lc = levels_.back();
+      const Scal factor = (coarse_aggregated_ ? conf_.correction : 1);
+      for (size_t k = 0; k < lc.cells.size(); ++k) {
+        lc.u[lc.cells[k]] += factor * coarse_sol_[coarse_index_[k]];
+      }
+      if (ns == nl || nl == 1) { // halos for smoothing or result
+        SendHalo(nl - 1, m);
+      }
+    }
+    for (int l = ns - 1; l >= 0; --l) {
+      if (l + 1 < nl) {
+        if (sem("prolong")) {
+          Prolong(l);
+          SendHalo(l, m);
+        }
+      }
+      for (int k = 0; k < conf_.nsmooth; ++k) {
+        if (sem("post")) {
+          RecvHalo(l);
+          Smooth(l, k);
+          SendHalo(l, m);
+        }
+      }
+    }
+    if (sem("result")) {
+      auto& l0 = levels_[0];
+      RecvHalo(0);
+      fc_z.Reinit(m, 0);
+      for (size_t k = 0; k < l0.cells.size(); ++k) {
+        fc_z[finecells_[k]] = l0.u[l0.cells[k]];
+      }
+      for (auto& p : l0.recv) {
+        fc_z[p.second] = l0.u[p.first];
+      }
+    }
+  }
+
+  Owner* owner_;
+  const Conf conf_;
+  std::vector<Level> levels_; // from finest to coarsest
+  std::vector<IdxCell> finecells_; // inner cells in order of level 0
+  FieldCell<Scal> fc_buf_; // buffer for halo exchange of all levels
+  int pending_ = -1; // level with requested halo exchange
+  MIdx coarse_size_; // size of grid of the coarsest system
+  // cells of the last level are aggregated and smoothed
+  bool coarse_aggregated_;
+  // index in the coarsest system of cells of the last level
+  std::vector<size_t> coarse_index_;
+  // index in the coarsest system of neighbors of cells of the last level
+  std::vector<std::array<size_t, dim * 2>> coarse_index_nb_;
+  std::vector<Scal> coarse_buf_; // buffer for reduction to root
+  std::vector<Scal> coarse_sol_; // solution of coarsest system
+  // coarsest system on root block
+  std::vector<Expr> coarse_system_;
+  std::vector<std::array<size_t, dim * 2>> coarse_nb_; // neighbors
+  bool coarse_singular_ = false; // rows sum to zero
+};
+
+template <class M>
+Multigrid<M>::Multigrid(const Conf& conf, const M& m)
+    : imp(new Imp(this, conf, m)) {}
+
+template <class M>
+Multigrid<M>::~Multigrid() = default;
+
+template <class M>
+void Multigrid<M>::Setup(const FieldCell<Expr>& fc_system, M& m) {
+  imp->Setup(fc_system, m);
+}
+
+template <class M>
+void Multigrid<M>::Setup(const SystemFaces<M>& sys, M& m) {
+  imp->Setup(sys, m);
+}
+
+template <class M>
+void Multigrid<M>::Cycle(
+    const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) {
+  imp->Cycle(fc_r, fc_z, m);
+}
+
+template <class M>
+int Multigrid<M>::GetNumLevels() const {
+  return imp->levels_.size();
+}
+
+template <class M>
+auto Multigrid<M>::GetConf(const Vars& var, std::string prefix) -> Conf {
+  auto addprefix = [prefix](std::string name) {
+    return "linsolver_" + prefix + "_" + name;
+  };
+  Conf conf;
+  conf.nsmooth = var.Int(addprefix("mg_nsmooth"), conf.nsmooth);
+  conf.smoother = var.String(addprefix("mg_smoother"), conf.smoother);
+  conf.omega = var.Double(addprefix("mg_omega"), conf.omega);
+  conf.correction = var.Double(addprefix("mg_correction"), conf.correction);
+  conf.max_levels = var.Int(addprefix("mg_levels"), conf.max_levels);
+  conf.chebyshev_ratio =
+      var.Double(addprefix("mg_chebyshev_ratio"), conf.chebyshev_ratio);
+  conf.coarse_tol = var.Double(addprefix("mg_coarse_tol"), conf.coarse_tol);
+  conf.coarse_maxiter =
+      var.Int(addprefix("mg_coarse_maxiter"), conf.coarse_maxiter);
+  conf.coarse_max = var.Int(addprefix("mg_coarse_max"), conf.coarse_max);
+  fassert(
+      conf.smoother == "jacobi" || conf.smoother == "chebyshev",
+      "Unknown " + addprefix("mg_smoother") + "=" + conf.smoother);
+  return conf;
+}
+
+template <class M>
+struct SolverMultigrid<M>::Imp {
+  using Owner = SolverMultigrid<M>;
+
+  Imp(Owner* owner, const Extra& extra_, const M& m)
+      : owner_(owner), conf(owner_->conf), extra(extra_), mg(extra.mg, m) {}
+  // System: FieldCell<Expr> or SystemFaces<M>
+  template <class System>
+  Info Solve(
+      const System& sys, const FieldCell<Scal>* fc_init,
+      FieldCell<Scal>& fc_sol, M& m) {
+    auto sem = m.GetSem(__func__);
+    struct {
+      FieldCell<Scal> fcu;
+      FieldCell<Scal> fcr;
+      FieldCell<Scal> fcz; // preconditioned residual
+      FieldCell<Scal> fcz_prev;
+      FieldCell<Scal> fcp;
+      FieldCell<Scal> fclp; // linear fc_system operator applied to p
+      Scal dot_rz;
+      Scal dot_rz_prev; // dot product of r and previous z
+      Scal dot_rz_old; // dot_rz from previous iteration
+      Scal dot_p_lp;
+      Scal dot_r;
+      Scal max_r;
+
+      int iter = 0;
+      Info info;
+    } * ctx(sem);
+    auto& t = *ctx;
+    if (sem("init")) {
+      if (fc_init) {
+        t.fcu = *fc_init;
+      } else {
+        t.fcu.Reinit(m, 0);
+      }
+      t.fcr.Reinit(m, 0);
+      ComputeResidual(sys, t.fcu, t.fcr, m);
+      t.fcp.Reinit(m, 0);
+      t.fcz_prev.Reinit(m, 0);
+      t.fclp.Reinit(m);
+    }
+    if (sem.Nested("setup")) {
+      mg.Setup(sys, m);
+    }
+    sem.LoopBegin();
+    if (sem.Nested("cycle")) {
+      mg.Cycle(t.fcr, t.fcz, m);
+    }
+    if (extra.cg) {
+      if (sem("dot")) {
+        t.dot_rz = 0;
+        t.dot_rz_prev = 0;
+        for (auto c : m.Cells()) {
+          t.dot_rz += t.fcr[c] * t.fcz[c];
+          t.dot_rz_prev += t.fcr[c] * t.fcz_prev[c];
+        }
+        m.Reduce(&t.dot_rz, Reduction::sum);
+        m.Reduce(&t.dot_rz_prev, Reduction::sum);
+      }
+      if (sem("direction")) {
+        // flexible variant, the preconditioner may change between iterations
+        Scal beta = 0;
+        if (t.iter > 0) {
+          beta = (t.dot_rz - t.dot_rz_prev) / (t.dot_rz_old + 1e-100);
+        }
+        // fcz and fcp have valid halos adjacent to faces
+        for (auto c : m.AllCells()) {
+          t.fcp[c] = t.fcz[c] + beta * t.fcp[c];
+        }
+        t.dot_p_lp = 0;
+        for (auto c : m.Cells()) {
+          t.fclp[c] = ApplyLinear(sys, t.fcp, c, m);
+          t.dot_p_lp += t.fcp[c] * t.fclp[c];
+        }
+        m.Reduce(&t.dot_p_lp, Reduction::sum);
+        t.fcz_prev.swap(t.fcz);
+        t.dot_rz_old = t.dot_rz;
+      }
+      if (sem("update")) {
+        const Scal alpha = t.dot_rz_old / (t.dot_p_lp + 1e-100);
+        t.dot_r = 0;
+        t.max_r = 0;
+        for (auto c : m.Cells()) {
+          t.fcu[c] += alpha * t.fcp[c];
+          t.fcr[c] -= alpha * t.fclp[c];
+          t.dot_r += sqr(t.fcr[c]);
+          t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
+        }
+        m.Reduce(&t.dot_r, Reduction::sum);
+        m.Reduce(&t.max_r, Reduction::max);
+      }
+    } else {
+      if (sem("update")) {
+        // fcz and fcu have valid halos adjacent to faces
+        for (auto c : m.AllCells()) {
+          t.fcu[c] += t.fcz[c];
+        }
+        ComputeResidual(sys, t.fcu, t.fcr, m);
+        t.dot_r = 0;
+        t.max_r = 0;
+        for (auto c : m.Cells()) {
+          t.dot_r += sqr(t.fcr[c]);
+          t.max_r = std::max(t.max_r, std::abs(t.fcr[c]));
+        }
+        m.Reduce(&t.dot_r, Reduction::sum);
+        m.Reduce(&t.max_r, Reduction::max);
+      }
+    }
+    if (sem("check")) {
+      if (extra.residual_max) {
+        t.info.residual = t.max_r / m.GetCellSize().prod();
+      } else { // L2-norm
+        t.info.residual = std::sqrt(t.dot_r / m.GetCellSize().prod());
+      }
+      ++t.iter;
+      t.info.iter = t.iter;
+      if (t.iter >= conf.miniter &&
+          (t.iter > conf.maxiter || t.info.residual < conf.tol)) {
+        sem.LoopBreak();
+      }
+    }
+    sem.LoopEnd();
+    if (sem("result")) {
+      fc_sol = t.fcu;
+      m.Comm(&fc_sol, M::CommStencil::direct_one);
+      if (m.flags.linreport && m.IsRoot()) {
+        std::cerr << std::scientific;
+        std::cerr << "linear(multigrid) '" + GetName(sys) + "':"
+                  << " res=" << t.info.residual << " iter=" << t.info.iter
+                  << " levels=" << mg.GetNumLevels() << std::endl;
+      }
+    }
+    if (sem()) {
+    }
+    return t.info;
+  }
+
+ private:
+  Owner* owner_;
+  Conf& conf;
+  Extra extra;
+  Multigrid<M> mg;
+};
+
+template <class M>
+SolverMultigrid<M>::SolverMultigrid(
+    const Conf& conf_, const Extra& extra, const M& m)
+    : Base(conf_), imp(new Imp(this, extra, m)) {}
+
+template <class M>
+SolverMultigrid<M>::~SolverMultigrid() = default;
+
+template <class M>
+auto SolverMultigrid<M>::Solve(
+    const FieldCell<Expr>& fc_system, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(fc_system, fc_init, fc_sol, m);
+}
+
+template <class M>
+auto SolverMultigrid<M>::SolveFaces(
+    const SystemFaces<M>& sys, const FieldCell<Scal>* fc_init,
+    FieldCell<Scal>& fc_sol, M& m) -> Info {
+  MEMTRACK_SCOPE("linear");
+  return imp->Solve(sys, fc_init, fc_sol, m);
+}
+
+template <class M>
+class ModuleLinearMultigrid : public ModuleLinear<M> {
+ public:
+  ModuleLinearMultigrid() : ModuleLinear<M>("multigrid") {}
+  std::unique_ptr<Solver<M>> Make(
+      const Vars& var, std::string prefix, const M& m) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    typename SolverMultigrid<M>::Extra extra;
+    extra.residual_max = var.Int(addprefix("maxnorm"), 0);
+    extra.cg = var.Int(addprefix("mg_cg"), 1);
+    extra.mg = Multigrid<M>::GetConf(var, prefix);
+    return std::make_unique<SolverMultigrid<M>>(
+        this->GetConf(var, prefix), extra, m);
+  }
+};
+
+// One V-cycle as preconditioner.
+template <class M>
+class PrecondMultigrid : public Precond<M> {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  PrecondMultigrid(const typename Multigrid<M>::Conf& conf, const M& m)
+      : mg_(conf, m) {}
+  void Setup(const FieldCell<Expr>& fc_system, M& m) override {
+    mg_.Setup(fc_system, m);
+  }
+  void SetupFaces(const SystemFaces<M>& sys, M& m) override {
+    mg_.Setup(sys, m);
+  }
+  void Apply(
+      const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) override {
+    mg_.Cycle(fc_r, fc_z, m);
+  }
+
+ private:
+  Multigrid<M> mg_;
+};
+
+template <class M>
+class ModulePrecondMultigrid : public ModulePrecond<M> {
+ public:
+  ModulePrecondMultigrid() : ModulePrecond<M>("multigrid") {}
+  std::unique_ptr<Precond<M>> Make(
+      const Vars& var, std::string prefix, const M& m) override {
+    return std::make_unique<PrecondMultigrid<M>>(
+        Multigrid<M>::GetConf(var, prefix), m);
+  }
+};
+
+} // namespace linear
@@ -0,0 +1,26 @@
+// Created by Petr Karnakov on 03.04.2021
+// Copyright 2021 ETH Zurich
+
+#include "precond.ipp"
+
+namespace linear {
+
+#define X(dim) \
+  RegisterModule<ModulePrecondJacobi<MeshCartesian<double, dim>>>(),
+bool kReg_precond_jacobi[] = {MULTIDIMX};
+#undef X
+
+#define X(dim) \
+  RegisterModule<ModulePrecondChebyshev<MeshCartesian<double, dim>>>(),
+bool kReg_precond_chebyshev[] = {MULTIDIMX};
+#undef X
+
+#define X(dim) RegisterModule<ModulePrecondSsor<MeshCartesian<double, dim>>>(),
+bool kReg_precond_ssor[] = {MULTIDIMX};
+#undef X
+
+#define X(dim) RegisterModule<ModulePrecondIc<MeshCartesian<double, dim>>>(),
+bool kReg_precond_ic[] = {MULTIDIMX};
+#undef X
+
+} // namespace linear
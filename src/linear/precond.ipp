@@ -0,0 +1,301 @@
+// Created by Petr Karnakov on 03.04.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include "linear.h"
+
+DECLARE_FORCE_LINK_TARGET(linear_precond);
+
+namespace linear {
+
+// Diagonal scaling z = r / e[0].
+template <class M>
+class PrecondJacobi : public Precond<M> {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  void Setup(const FieldCell<Expr>& fc_system, M& m) override {
+    auto sem = m.GetSem("setup");
+    if (sem()) {
+      fc_system_ = &fc_system;
+    }
+  }
+  void Apply(
+      const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) override {
+    auto sem = m.GetSem("apply");
+    if (sem()) {
+      const auto& fc_system = *fc_system_;
+      fc_z.Reinit(m);
+      for (auto c : m.Cells()) {
+        fc_z[c] = fc_r[c] / fc_system[c][0];
+      }
+    }
+  }
+
+ private:
+  const FieldCell<Expr>* fc_system_ = nullptr;
+};
+
+// Chebyshev polynomial of D^{-1} A of fixed degree,
+// approximates the inverse on interval [ratio * lmax, lmax]
+// where lmax is the Gershgorin bound of eigenvalues.
+// Each degree above one requires a halo exchange.
+template <class M>
+class PrecondChebyshev : public Precond<M> {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+
+  PrecondChebyshev(int degree, Scal ratio) : degree_(degree), ratio_(ratio) {
+    fassert(
+        degree_ >= 1,
+        "Expected positive degree, got " + std::to_string(degree_));
+  }
+  void Setup(const FieldCell<Expr>& fc_system, M& m) override {
+    auto sem = m.GetSem("setup");
+    if (sem("lmax")) {
+      fc_system_ = &fc_system;
+      lmax_ = 0;
+      for (auto c : m.Cells()) {
+        const auto& e = fc_system[c];
+        Scal sum = 0;
+        for (size_t q = 0; q + 1 < e.size(); ++q) {
+          sum += std::abs(e[q]);
+        }
+        lmax_ = std::max(lmax_, sum / std::abs(e[0]));
+      }
+      m.Reduce(&lmax_, Reduction::max);
+    }
+  }
+  void Apply(
+      const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) override {
+    auto sem = m.GetSem("apply");
+    const auto& fc_system = *fc_system_;
+    const Scal theta = lmax_ * (1 + ratio_) * 0.5;
+    const Scal delta = lmax_ * (1 - ratio_) * 0.5;
+    const Scal sigma = theta / delta;
+    if (sem("init")) {
+      rho_ = 1 / sigma;
+      fc_z.Reinit(m, 0);
+      fcd_.Reinit(m);
+      for (auto c : m.Cells()) {
+        fcd_[c] = fc_r[c] / (theta * fc_system[c][0]);
+        fc_z[c] = fcd_[c];
+      }
+      if (degree_ > 1) {
+        m.Comm(&fc_z, M::CommStencil::direct_one);
+      }
+    }
+    for (int k = 1; k < degree_; ++k) {
+      if (sem("iter")) {
+        const Scal rho = 1 / (2 * sigma - rho_);
+        for (auto c : m.Cells()) {
+          const auto& e = fc_system[c];
+          Scal a = fc_z[c] * e[0];
+          for (auto q : m.Nci(c)) {
+            a += fc_z[m.GetCell(c, q)] * e[1 + q.raw()];
+          }
+          fcd_[c] =
+              rho * rho_ * fcd_[c] + 2 * rho / delta * (fc_r[c] - a) / e[0];
+        }
+        for (auto c : m.Cells()) {
+          fc_z[c] += fcd_[c];
+        }
+        rho_ = rho;
+        if (k + 1 < degree_) {
+          m.Comm(&fc_z, M::CommStencil::direct_one);
+        }
+      }
+    }
+  }
+
+ private:
+  const int degree_;
+  const Scal ratio_;
+  const FieldCell<Expr>* fc_system_ = nullptr;
+  Scal lmax_;
+  Scal rho_;
+  FieldCell<Scal> fcd_; // direction
+};
+
+// Base for preconditioners applied to the block-local part of the system
+// by forward and backward substitution with coefficients
+// of neighbors in halo cells dropped, needs no halo exchange.
+// Cells are ordered as in m.Cells(), neighbors in
+// directions 2 * d precede the cell and 2 * d + 1 follow.
+template <class M>
+class PrecondBlockLocal : public Precond<M> {
+ public:
+  using Scal = typename M::Scal;
+  using Expr = typename M::Expr;
+  static constexpr size_t dim = M::dim;
+
+  void Setup(const FieldCell<Expr>& fc_system, M& m) override {
+    auto sem = m.GetSem("setup");
+    if (sem()) {
+      fc_system_ = &fc_system;
+      if (cells_.empty()) {
+        for (auto c : m.Cells()) {
+          cells_.push_back(c);
+        }
+      }
+      fc_diag_.Reinit(m, 0);
+      SetupDiag(m);
+    }
+  }
+  void Apply(
+      const FieldCell<Scal>& fc_r, FieldCell<Scal>& fc_z, M& m) override {
+    auto sem = m.GetSem("apply");
+    if (sem()) {
+      const auto& fc_system = *fc_system_;
+      // forward substitution (D + L) y = r
+      fcy_.Reinit(m, 0);
+      for (auto c : cells_) {
+        const auto& e = fc_system[c];
+        Scal a = fc_r[c];
+        for (size_t d = 0; d < dim; ++d) {
+          a -= e[1 + 2 * d] * fcy_[m.GetCell(c, IdxNci(2 * d))];
+        }
+        fcy_[c] = a / fc_diag_[c];
+      }
+      // backward substitution (D + U) z = D' y
+      fc_z.Reinit(m, 0);
+      for (auto it = cells_.rbegin(); it != cells_.rend(); ++it) {
+        const IdxCell c = *it;
+        const auto& e = fc_system[c];
+        Scal a = GetScaledDiag(c) * fcy_[c];
+        for (size_t d = 0; d < dim; ++d) {
+          a -= e[2 + 2 * d] * fc_z[m.GetCell(c, IdxNci(2 * d + 1))];
+        }
+        fc_z[c] = a / fc_diag_[c];
+      }
+    }
+  }
+
+ protected:
+  // Computes diagonal D in inner cells
+  virtual void SetupDiag(const M& m) = 0;
+  // Returns diagonal D' of the middle factor in cell c
+  virtual Scal GetScaledDiag(IdxCell c) const = 0;
+
+  const FieldCell<Expr>* fc_system_ = nullptr;
+  FieldCell<Scal> fc_diag_; // diagonal of factors, zero in halo cells
+  std::vector<IdxCell> cells_;
+  FieldCell<Scal> fcy_;
+};
+
+// Symmetric successive over-relaxation
+//   P^{-1} = w / (2 - w) * (D / w + L) D^{-1} (D / w + U)
+template <class M>
+class PrecondSsor : public PrecondBlockLocal<M> {
+ public:
+  using Base = PrecondBlockLocal<M>;
+  using Scal = typename M::Scal;
+
+  PrecondSsor(Scal omega) : omega_(omega) {
+    fassert(0 < omega_ && omega_ < 2, "Expected 0 < omega < 2");
+  }
+
+ protected:
+  void SetupDiag(const M& m) override {
+    const auto& fc_system = *this->fc_system_;
+    for (auto c : m.Cells()) {
+      this->fc_diag_[c] = fc_system[c][0] / omega_;
+    }
+  }
+  Scal GetScaledDiag(IdxCell c) const override {
+    return (*this->fc_system_)[c][0] * (2 - omega_) / omega_;
+  }
+
+ private:
+  const Scal omega_;
+};
+
+// Incomplete Cholesky factorization without fill-in
+//   P^{-1} = (D + L) D^{-1} (D + U)
+// for symmetric systems.
+template <class M>
+class PrecondIc : public PrecondBlockLocal<M> {
+ public:
+  using Base = PrecondBlockLocal<M>;
+  using Scal = typename M::Scal;
+  static constexpr size_t dim = M::dim;
+
+ protected:
+  void SetupDiag(const M& m) override {
+    const auto& fc_system = *this->fc_system_;
+    auto& fc_diag = this->fc_diag_;
+    for (auto c : this->cells_) {
+      const auto& e = fc_system[c];
+      Scal a = e[0];
+      for (size_t d = 0; d < dim; ++d) {
+        const IdxCell cm = m.GetCell(c, IdxNci(2 * d));
+        if (fc_diag[cm] != 0) {
+          a -= sqr(e[1 + 2 * d]) / fc_diag[cm];
+        }
+      }
+      fc_diag[c] = a;
+    }
+  }
+  Scal GetScaledDiag(IdxCell c) const override {
+    return this->fc_diag_[c];
+  }
+};
+
+template <class M>
+class ModulePrecondJacobi : public ModulePrecond<M> {
+ public:
+  ModulePrecondJacobi() : ModulePrecond<M>("jacobi") {}
+  std::unique_ptr<Precond<M>> Make(
+      const Vars&, std::string, const M&) override {
+    return std::make_unique<PrecondJacobi<M>>();
+  }
+};
+
+template <class M>
+class ModulePrecondChebyshev : public ModulePrecond<M> {
+ public:
+  ModulePrecondChebyshev() : ModulePrecond<M>("chebyshev") {}
+  std::unique_ptr<Precond<M>> Make(
+      const Vars& var, std::string prefix, const M&) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    return std::make_unique<PrecondChebyshev<M>>(
+        var.Int(addprefix("precond_degree"), 3),
+        var.Double(addprefix("precond_ratio"), 0.1));
+  }
+};
+
+template <class M>
+class ModulePrecondSsor : public ModulePrecond<M> {
+ public:
+  ModulePrecondSsor() : ModulePrecond<M>("ssor") {}
+  std::unique_ptr<Precond<M>> Make(
+      const Vars& var, std::string prefix, const M&) override {
+    auto addprefix = [prefix](std::string name) {
+      return "linsolver_" + prefix + "_" + name;
+    };
+    return std::make_unique<PrecondSsor<M>>(
+        var.Double(addprefix("precond_omega"), 1.5));
+  }
+};
+
+template <class M>
+class ModulePrecondIc : public ModulePrecond<M> {
+ public:
+  ModulePrecondIc() : ModulePrecond<M>("ic") {}
+  std::unique_ptr<Precond<M>> Make(
+      const Vars&, std::string, const M&) override {
+    return std::make_unique<PrecondIc<M>>();
+  }
+};
+
+} // namespace linear
@@ -38,6 +38,7 @@ struct ParsePar<Proj<M>> {
     p.inletpressure_factor = var.Double["inletpressure_factor"];
     p.diffusion_iters = var.Int["proj_diffusion_iters"];
     p.diffusion_consistent_guess = var.Int["proj_diffusion_consistent_guess"];
+    p.pressure_faces = var.Int("proj_pressure_faces", 0);
     return p;
   }
 };
@@ -115,7 +115,7 @@ template <class T>
 void Vars::Map<T>::SetStr(Key k, std::string v) {
   std::stringstream b(v);
   b >> std::skipws;
-  b >> m_[k];
+  b >> Insert(k);
 
   fassert(
       !b.fail(), //
@@ -148,12 +148,12 @@ void Vars::Map<std::vector<double>>::SetStr(Key k, std::string s) {
               "' for variable named '" + k + "'");
     }
   }
-  m_[k] = r;
+  Insert(k) = r;
 }
 
 template <>
 void Vars::Map<std::string>::SetStr(Key k, std::string s) {
-  m_[k] = s;
+  Insert(k) = s;
 }
 
 template <class T>
@@ -208,7 +208,17 @@ auto Vars::Map<T>::operator()(Key k, Value def) const -> Value {
 
 template <class T>
 void Vars::Map<T>::Set(Key k, const T& v) {
-  m_[k] = v;
+  Insert(k) = v;
+}
+
+template <class T>
+auto Vars::Map<T>::Insert(Key k) -> Value& {
+  auto it = m_.find(k);
+  if (it == m_.end()) {
+    it = m_.emplace(k, Value()).first;
+    version_ = NextVersion();
+  }
+  return it->second;
 }
 
 template <class T>
@@ -219,6 +229,7 @@ bool Vars::Map<T>::Contains(Key k) const {
 template <class T>
 void Vars::Map<T>::Del(Key k) {
   m_.erase(m_.find(k));
+  version_ = NextVersion();
 }
 
 template <class T>
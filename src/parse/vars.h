@@ -3,11 +3,14 @@
 
 #pragma once
 
+#include <atomic>
 #include <functional>
 #include <map>
 #include <string>
 #include <vector>
 
+#include "util/logger.h"
+
 class Vars {
  public:
   using Key = std::string;
@@ -19,6 +22,13 @@ class Vars {
 
     Map() : hook_([](const Key&) {}) {}
     Map(std::function<void(const Key&)> hook) : hook_(hook) {}
+    Map(const Map& o) : m_(o.m_), hook_(o.hook_) {}
+    Map& operator=(const Map& o) {
+      m_ = o.m_;
+      hook_ = o.hook_;
+      version_ = NextVersion();
+      return *this;
+    }
 
     std::string GetTypeName() const;
     std::string GetStr(Key) const;
@@ -46,11 +56,82 @@ class Vars {
     }
     static std::string ValueToStr(Value value);
 
+    // Reference to a variable for repeated access in hot paths.
+    // The key is resolved on first access and again only after
+    // variables were added to or deleted from the map,
+    // so changes of the value (e.g. by Events) are visible immediately.
+    // Not thread-safe: each block should keep its own handles.
+    class Handle {
+     public:
+      Handle() = default;
+      // Returns current value or default if not found
+      const Value& Get() const {
+        const Value* ptr = Find();
+        if (!ptr) {
+          fassert(
+              hasdef_, "variable '" + key_ + "' of type '" +
+                           map_->GetTypeName() + "' not found");
+          return def_;
+        }
+        return *ptr;
+      }
+      const Value& operator*() const {
+        return Get();
+      }
+      // Returns pointer to current value or nullptr if not found
+      const Value* Find() const {
+        if (version_ != map_->version_) {
+          ptr_ = map_->Find(key_);
+          version_ = map_->version_;
+        }
+        return ptr_;
+      }
+      const Key& GetKey() const {
+        return key_;
+      }
+
+     private:
+      friend class Map;
+      Handle(const Map* map, Key key) : map_(map), key_(key) {}
+      Handle(const Map* map, Key key, Value def)
+          : map_(map), key_(key), def_(def), hasdef_(true) {}
+
+      const Map* map_ = nullptr;
+      Key key_;
+      Value def_ = Value();
+      bool hasdef_ = false;
+      mutable const Value* ptr_ = nullptr;
+      mutable size_t version_ = 0; // never returned by NextVersion()
+    };
+
+    // Returns handle to variable `key` which must exist on first access
+    Handle GetHandle(Key key) const {
+      return Handle(this, key);
+    }
+    // Returns handle to variable `key` or `def` if not found
+    Handle GetHandle(Key key, Value def) const {
+      return Handle(this, key, def);
+    }
+
    private:
+    // Returns reference to value, inserts default value if not found
+    Value& Insert(Key);
+    // Returns a new unique version
+    static size_t NextVersion() {
+      static std::atomic<size_t> next{1};
+      return next++;
+    }
+
     std::map<Key, Value> m_;
     std::function<void(const Key&)> hook_;
+    // Changed after insertion or deletion of elements.
+    // Values stay at the same address otherwise.
+    size_t version_ = NextVersion();
   };
 
+  template <class T>
+  using Handle = typename Map<T>::Handle;
+
   Vars() = default;
   Vars(std::function<void(const Key&)> hook)
       : String(hook), Int(hook), Double(hook), Vect(hook) {}
@@ -31,6 +31,8 @@ struct ProjPar {
                             // if true else RedistributeCutCells()
   size_t diffusion_iters = 1; // number of iterations in implicit diffusion
   bool diffusion_consistent_guess = false;
+  // pressure system with coefficients on faces, Cartesian mesh only
+  bool pressure_faces = false;
 };
 
 template <class M>
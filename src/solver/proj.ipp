@@ -331,6 +331,19 @@ struct Proj<EB_>::Imp {
       }
     }
   }
+  void ApplyCellCond(
+      const FieldCell<Scal>& fcpb, linear::SystemFaces<M>& sys) {
+    (void)fcpb;
+    for (auto& it : mccp_) {
+      const IdxCell c = it.first; // target cell
+      const CondCell* cb = it.second.get(); // cond base
+      if (auto cd = dynamic_cast<const CondCellVal<Scal>*>(cb)) {
+        const Scal pc = cd->second(); // new value for p[c]
+        sys.fc_diag[c] += 1;
+        sys.fc_rhs[c] -= pc;
+      }
+    }
+  }
   // Adds pressure gradient term to flux.
   // fcp: pressure
   // fck: diagonal coefficient
@@ -375,20 +388,61 @@ struct Proj<EB_>::Imp {
     }
     return fce;
   }
+  // Same as GetFluxSum() with coefficients on faces,
+  // assumes that the coefficients are symmetric.
+  linear::SystemFaces<M> GetFluxSumFaces(
+      const FieldFace<ExprFace>& ffv, const FieldCell<Scal>& fcsv) {
+    linear::SystemFaces<M> sys;
+    // initialize as diagonal system
+    sys.fc_diag.Reinit(m, 1);
+    sys.ff_coeff.Reinit(m, 0);
+    sys.fc_rhs.Reinit(m, 0);
+    for (auto c : m.Cells()) {
+      Scal diag = 0;
+      Scal rhs = 0;
+      for (auto q : m.Nci(c)) {
+        const IdxFace f = m.GetFace(c, q);
+        const ExprFace v = ffv[f] * m.GetOutwardFactor(c, q);
+        // same as M::AppendExpr()
+        diag += v[1 - q.raw() % 2];
+        sys.ff_coeff[f] = v[q.raw() % 2];
+        rhs += v.back();
+      }
+      sys.fc_diag[c] = diag;
+      sys.fc_rhs[c] = rhs - fcsv[c] * m.GetVolume(c);
+    }
+    return sys;
+  }
+  linear::SystemFaces<M> GetFluxSumFaces(
+      const FieldEmbed<ExprFace>&, const FieldCell<Scal>&) {
+    fassert(false, "proj_pressure_faces=1 is not supported with embed");
+    return {};
+  }
   void Project(FieldCell<Scal>& fcp, FieldFaceb<Scal>& ffv, Scal dt) {
     auto sem = m.GetSem("project");
     struct {
       FieldFaceb<ExprFace> ffvc; // expression for corrected volume flux [i]
       FieldCell<Expr> fcpcs; // linear system for pressure [i]
+      linear::SystemFaces<M> sys_faces; // same with coefficients on faces
     } * ctx(sem);
     if (sem("local")) {
       ctx->ffvc = GetFlux(ffv, dt);
-      ctx->fcpcs = GetFluxSum(ctx->ffvc, *owner_->fcsv_);
-      ApplyCellCond(fcp, ctx->fcpcs);
-      ctx->fcpcs.SetName("pressure");
+      if (par.pressure_faces) {
+        ctx->sys_faces = GetFluxSumFaces(ctx->ffvc, *owner_->fcsv_);
+        ApplyCellCond(fcp, ctx->sys_faces);
+        ctx->sys_faces.fc_diag.SetName("pressure");
+      } else {
+        ctx->fcpcs = GetFluxSum(ctx->ffvc, *owner_->fcsv_);
+        ApplyCellCond(fcp, ctx->fcpcs);
+        ctx->fcpcs.SetName("pressure");
+      }
     }
     if (sem.Nested("solve")) {
-      linsolver_->Solve(ctx->fcpcs, &fcp, fcp, m);
+      if (par.pressure_faces) {
+        linsolver_->SolveFaces(ctx->sys_faces, &fcp, fcp, m);
+      } else {
+        linsolver_->Solve(ctx->fcpcs, &fcp, fcp, m);
+      }
     }
     if (sem("fluxes")) {
       eb.LoopFaces([&](auto cf) { //
@@ -352,7 +352,7 @@ struct Vof<EB_>::Imp {
       Sem& sem, FieldCell<Scal>& uc, FieldCell<Scal>& fccl,
       FieldCell<Scal>& fcim) {
     if (sem("comm")) {
-      m.Comm(&uc);
+      m.CommLossy(&uc);
       m.Comm(&fccl);
       m.Comm(&fcim);
     }
@@ -640,7 +640,7 @@ struct Vofm<EB_>::Imp {
       const Multi<FieldCell<Scal>*>& mfcim) {
     if (sem("comm")) {
       for (auto i : layers) {
-        m.Comm(mfcu[i]);
+        m.CommLossy(mfcu[i]);
         m.Comm(mfccl[i]);
         m.Comm(mfcim[i]);
       }
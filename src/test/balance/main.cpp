@@ -0,0 +1,70 @@
+// Created by Petr Karnakov on 15.03.2021
+// Copyright 2021 ETH Zurich
+
+#undef NDEBUG
+#include <cassert>
+#include <iostream>
+#include <sstream>
+
+#include "distr/balance.h"
+
+using MIdx = generic::MIdx<2>;
+
+void TestMorton() {
+  std::cout << "\n" << __func__ << std::endl;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      std::cout << balance::GetMortonIndex<2>(MIdx(x, y)) << " ";
+    }
+    std::cout << std::endl;
+  }
+}
+
+void TestPartition() {
+  std::cout << "\n" << __func__ << std::endl;
+  std::vector<MIdx> ww;
+  std::vector<double> cost;
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      ww.emplace_back(x, y);
+      // expensive blocks in one corner
+      cost.push_back(x < 2 && y < 2 ? 4 : 1);
+    }
+  }
+  const int nparts = 4;
+  const auto part =
+      balance::Partition(cost, balance::GetMortonOrder<2>(ww), nparts);
+  for (int y = 0; y < 4; ++y) {
+    for (int x = 0; x < 4; ++x) {
+      std::cout << part[y * 4 + x] << " ";
+    }
+    std::cout << std::endl;
+  }
+  // uniform partition into quadrants
+  std::vector<int> quad;
+  for (auto w : ww) {
+    quad.push_back((w[0] / 2) + (w[1] / 2) * 2);
+  }
+  std::cout << "imbalance quadrants="
+            << balance::GetImbalance(cost, quad, nparts)
+            << " partition=" << balance::GetImbalance(cost, part, nparts)
+            << std::endl;
+}
+
+void TestReadPartition() {
+  std::cout << "\n" << __func__ << std::endl;
+  std::stringstream in;
+  in << "x,y,rank,cost,partition\n";
+  in << "0,0,0,4,0\n";
+  in << "1,0,1,1,2\n";
+  in << "0,1,2,1,1\n";
+  for (auto p : balance::ReadPartition<2>(in)) {
+    std::cout << p.first << " " << p.second << std::endl;
+  }
+}
+
+int main() {
+  TestMorton();
+  TestPartition();
+  TestReadPartition();
+}
@@ -1,6 +1,7 @@
 // Created by Petr Karnakov on 30.05.2018
 // Copyright 2018 ETH Zurich
 
+#include <array>
 #include <cassert>
 #include <cmath>
 #include <functional>
@@ -679,10 +680,12 @@ class StencilField : public TimerMesh {
 // mem: memory usage in bytes
 // cover: covered range of cells
 // name: test name
+// counters: hardware counters per call, negative if unavailable
 // Returns 1 if test with index test found
 bool RunTest(
     const size_t test, M& m, /*out*/ double& time, size_t& iters, size_t& mem,
-    Cover& cover, std::string& name) {
+    Cover& cover, std::string& name,
+    std::array<double, PerfCounters::kNumCounters>& counters) {
   size_t k = 0;
   TimerMesh* p = nullptr;
 
@@ -733,6 +736,7 @@ bool RunTest(
   auto e = p->Run();
   time = e.min_call_time;
   iters = e.iters;
+  counters = e.counters;
   mem = sysinfo::GetMem();
   cover = p->GetCover();
   name = p->GetName();
@@ -744,13 +748,14 @@ bool RunTest(
 int main() {
   const std::vector<MIdx> meshsizes = {MIdx(8), MIdx(16), MIdx(32)};
 
-  const std::string fmt = "{:22}{:13.2f}{:8}{:8}{:10.1f}{:17}\n";
+  const std::string fmt = "{:22}{:13.2f}{:8}{:8}{:10.1f}{:17}{:8}{:14}\n";
 
   std::stringstream header;
   using std::setw;
   header << util::Format(
       fmt, //
-      "name", "t/cell[ns]", "cover", "iters", "mem[MB]", "mem/allcells[B]");
+      "name", "t/cell[ns]", "cover", "iters", "mem[MB]", "mem/allcells[B]",
+      "ipc", "llcmiss/cell");
 
   for (auto meshsize : meshsizes) {
     size_t mem0 = sysinfo::GetMem();
@@ -768,7 +773,8 @@ int main() {
     size_t mem;
     Cover cover;
     std::string name;
-    while (RunTest(test++, m, time, iters, mem, cover, name)) {
+    std::array<double, PerfCounters::kNumCounters> cnt;
+    while (RunTest(test++, m, time, iters, mem, cover, name, cnt)) {
       size_t dmem = mem - mem0;
       const auto covcells =
           (cover == Cover::all  ? allcells
@@ -778,10 +784,18 @@ int main() {
           (cover == Cover::all  ? "all"
            : cover == Cover::in ? "in"
                                 : "su");
+      // Hardware counters, '-' if unavailable
+      const double cyc = cnt[PerfCounters::kCycles];
+      const double ins = cnt[PerfCounters::kInstructions];
+      const double llc = cnt[PerfCounters::kCacheMisses];
+      const std::string ipc =
+          (cyc > 0 && ins >= 0 ? util::Format("{:.2f}", ins / cyc) : "-");
+      const std::string llcpercell =
+          (llc >= 0 ? util::Format("{:.4f}", llc / covcells) : "-");
       std::cout << util::Format(
           fmt, //
           name, time * 1e9 / covcells, covname, iters, (dmem / double(1 << 20)),
-          (dmem / allcells));
+          (dmem / allcells), ipc, llcpercell);
     }
     std::cout << std::endl;
   }
@@ -0,0 +1,108 @@
+// Created by Petr Karnakov on 31.03.2021
+// Copyright 2021 ETH Zurich
+
+#undef NDEBUG
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+#include <iostream>
+
+#include "distr/distrbasic.h"
+#include "parse/argparse.h"
+#include "util/distr.h"
+#include "util/format.h"
+#include "util/timer.h"
+
+using M = MeshCartesian<double, 3>;
+using Scal = typename M::Scal;
+using MIdx = typename M::MIdx;
+
+// Explicit diffusion steps with halo exchange on a fixed mesh.
+// Reports time per step for the current layout of ranks and threads.
+void Run(M& m, Vars& var) {
+  auto sem = m.GetSem(__func__);
+  struct {
+    FieldCell<Scal> fc;
+    FieldCell<Scal> fc_new;
+    SingleTimer timer;
+    Scal time_start;
+    Scal sum;
+  } * ctx(sem);
+  auto& t = *ctx;
+  const int steps = var.Int["steps"];
+  if (sem("init")) {
+    t.fc.Reinit(m, 0);
+    t.fc_new.Reinit(m, 0);
+    for (auto c : m.CellsM()) {
+      t.fc[c] = std::sin(2 * M_PI * c.center[0]) *
+                std::sin(2 * M_PI * c.center[1]) *
+                std::sin(2 * M_PI * c.center[2]);
+    }
+    m.Comm(&t.fc);
+  }
+  if (sem("start")) {
+    t.time_start = t.timer.GetSeconds();
+  }
+  for (int i = 0; i < steps; ++i) {
+    if (sem("step")) {
+      const Scal a = 1. / 12;
+      for (auto c : m.Cells()) {
+        Scal lap = -6 * t.fc[c];
+        for (auto q : m.Nci(c)) {
+          lap += t.fc[m.GetCell(c, q)];
+        }
+        t.fc_new[c] = t.fc[c] + a * lap;
+      }
+      t.fc.swap(t.fc_new);
+      m.Comm(&t.fc);
+    }
+  }
+  if (sem("sum")) {
+    t.sum = 0;
+    for (auto c : m.Cells()) {
+      t.sum += t.fc[c];
+    }
+    m.Reduce(&t.sum, Reduction::sum);
+  }
+  if (sem("report")) {
+    if (m.IsRoot()) {
+      const int ranks = MpiWrapper(m.GetMpiComm()).GetCommSize();
+      int threads = 1;
+#ifdef _OPENMP
+      threads = omp_get_max_threads();
+#endif
+      const double time = (t.timer.GetSeconds() - t.time_start) / steps;
+      std::cout << util::Format(
+                       "ranks={} threads={} time_per_step={:.6f} sum={:.6f}",
+                       ranks, threads, time, t.sum)
+                << std::endl;
+    }
+  }
+}
+
+int main(int argc, const char** argv) {
+  MpiWrapper mpi(&argc, &argv);
+
+  ArgumentParser parser(
+      "Benchmark of layouts of ranks and threads.", mpi.IsRoot());
+  parser.AddVariable<int>("--mesh", 64).Help("Mesh size in all directions");
+  parser.AddVariable<int>("--block", 16).Help("Block size in all directions");
+  parser.AddVariable<int>("--steps", 100).Help("Number of steps");
+  parser.AddVariable<std::string>("--extra", "")
+      .Help("Extra configuration (commands 'set ... ')");
+  auto args = parser.ParseArgs(argc, argv);
+  if (const int* p = args.Int.Find("EXIT")) {
+    return *p;
+  }
+
+  const MIdx mesh_size(args.Int["mesh"]);
+  const MIdx block_size(args.Int["block"]);
+  Subdomains<MIdx> sub(mesh_size, block_size, mpi.GetCommSize());
+
+  std::string conf = sub.GetConfig();
+  conf += "\nset string backend native";
+  conf += "\nset int steps " + args.Int.GetStr("steps");
+  conf += "\n" + args.String["extra"];
+
+  return RunMpiBasicString<M>(mpi, Run, conf);
+}
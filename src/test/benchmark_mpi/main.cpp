@@ -62,9 +62,7 @@ void Run(M& m, Vars&) {
     }
   }
   if (sem()) {
-    if (m.IsRoot()) {
-      m.TimerReport("timer.log");
-    }
+    m.TimerReport("timer.log");
   }
   if (sem()) {
   }
@@ -0,0 +1,117 @@
+// Created by Petr Karnakov on 01.04.2021
+// Copyright 2021 ETH Zurich
+
+#undef NDEBUG
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "parse/vars.h"
+#include "util/format.h"
+#include "util/timer.h"
+
+// Compares access to variables by key and by handle.
+// Each block reads the variables that Hydro reads in every step.
+
+// Variables read in every step
+const std::vector<std::string> kInt = {
+    "max_step",        "report_step_every", "enable_fluid", "enable_advection",
+    "enable_bubgen",   "enable_erasevf",    "stat_dissip",  "enstrophy",
+    "stat_step_every", "min_iter",          "max_iter",     "vfsmooth",
+    "enable_surftens", "dim",               "dumppart",     "dumppartinter"};
+const std::vector<std::string> kDouble = {
+    "tmax", "stop_diff", "cfl", "cfla", "dtmax", "abortvel",
+    "tol",  "rho1",      "rho2", "mu1",  "mu2"};
+
+// Fills variables with keys from kInt and kDouble
+// and `nother` other variables of each type
+// to have the size of maps comparable to a typical configuration.
+Vars GetVars(int nother) {
+  Vars var;
+  for (auto& k : kInt) {
+    var.Int.Set(k, 1);
+  }
+  for (auto& k : kDouble) {
+    var.Double.Set(k, 1);
+  }
+  for (int i = 0; i < nother; ++i) {
+    var.Int.Set("other_int_" + std::to_string(i), i);
+    var.Double.Set("other_double_" + std::to_string(i), i);
+  }
+  return var;
+}
+
+// Returns time of one step of one block in seconds
+template <class F>
+double Measure(int nblocks, int nsteps, F step) {
+  SingleTimer timer;
+  double sum = 0;
+  for (int s = 0; s < nsteps; ++s) {
+    for (int b = 0; b < nblocks; ++b) {
+      sum += step(b);
+    }
+  }
+  const double time = timer.GetSeconds();
+  assert(sum > 0);
+  return time / (nsteps * nblocks);
+}
+
+int main() {
+  const int nblocks = 1000;
+  const int nsteps = 100;
+  const std::vector<int> vnother = {0, 200, 1000};
+
+  const std::string fmt = "{:10}{:12}{:12}{:12}{:14}\n";
+  std::cout << util::Format(
+      fmt, "other", "key[ns]", "handle[ns]", "speedup", "key/step[ms]");
+  for (int nother : vnother) {
+    Vars var = GetVars(nother);
+
+    const double tkey = Measure(nblocks, nsteps, [&](int) {
+      double sum = 0;
+      for (auto& k : kInt) {
+        sum += var.Int[k];
+      }
+      for (auto& k : kDouble) {
+        sum += var.Double[k];
+      }
+      return sum;
+    });
+
+    // Handles for each block as stored in Hydro
+    struct Handles {
+      std::vector<Vars::Handle<int>> hint;
+      std::vector<Vars::Handle<double>> hdouble;
+    };
+    std::vector<Handles> blocks(nblocks);
+    for (auto& h : blocks) {
+      for (auto& k : kInt) {
+        h.hint.push_back(var.Int.GetHandle(k));
+      }
+      for (auto& k : kDouble) {
+        h.hdouble.push_back(var.Double.GetHandle(k));
+      }
+    }
+    const double thandle = Measure(nblocks, nsteps, [&](int b) {
+      double sum = 0;
+      for (auto& h : blocks[b].hint) {
+        sum += *h;
+      }
+      for (auto& h : blocks[b].hdouble) {
+        sum += *h;
+      }
+      return sum;
+    });
+
+    // Handle stays valid after changes
+    var.Int.SetStr(kInt[0], "2");
+    assert(*blocks[0].hint[0] == 2);
+    var.Int.Set("new", 3);
+    assert(*blocks[0].hint[0] == 2);
+
+    std::cout << util::Format(
+        "{:10}{:12.1f}{:12.1f}{:12.1f}{:14.3f}\n", nother, tkey * 1e9,
+        thandle * 1e9, tkey / thandle, tkey * nblocks * 1e3);
+  }
+}
@@ -192,6 +192,94 @@ void Test<M>::TestComm() {
       }
     }
   }
+  if (sem("init-stencils")) {
+    fc_.Reinit(m, 0);
+    fcv_.Reinit(m, Vect(0));
+    for (auto c : m.Cells()) {
+      auto x = m.GetCenter(c);
+      fc_[c] = func(x);
+      fcv_[c] = funcv(x);
+    }
+    // fields with different stencils in one stage
+    m.Comm(&fc_, M::CommStencil::full_one);
+    m.Comm(&fcv_, 1, M::CommStencil::direct_two);
+  }
+  if (sem("check-stencils")) {
+    const auto& bi = m.GetInBlockCells();
+    for (auto c : m.AllCells()) {
+      const auto x = m.GetCenter(c);
+      const MIdx w = bc.GetMIdx(c);
+      // distance from inner cells in each direction
+      const MIdx dw = (bi.GetBegin() - w)
+                          .max(w - bi.GetBegin() - bi.GetSize() + MIdx(1))
+                          .max(MIdx(0));
+      size_t nnz = 0;
+      for (size_t d = 0; d < dim; ++d) {
+        nnz += (dw[d] != 0);
+      }
+      if (dw.max() <= 1 && !Cmp(fc_[c], func(x))) {
+        fout << w << " " << fc_[c] << " != " << func(x) << std::endl;
+        fassert(false);
+      }
+      if (nnz <= 1 && !Cmp(fcv_[c][1], funcv(x)[1])) {
+        fout << w << " " << fcv_[c][1] << " != " << funcv(x)[1] << std::endl;
+        fassert(false);
+      }
+    }
+  }
+  // piecewise constant field, like volume fraction
+  auto step = [&](Vect x) -> Scal {
+    auto gl = m.GetGlobalLength();
+    x = (x + 16 * gl) / gl;
+    x = x - Vect(MIdx(x));
+    return x[0] < 0.3 ? 0 : x[1] < 0.6 ? 1 : 0.5;
+  };
+  if (sem("init-step")) {
+    fc_.Reinit(m, 0);
+    for (auto c : m.Cells()) {
+      fc_[c] = step(m.GetCenter(c));
+    }
+    m.Comm(&fc_);
+  }
+  if (sem("check-step")) {
+    for (auto c : m.AllCells()) {
+      const auto x = m.GetCenter(c);
+      if (!Cmp(fc_[c], step(x))) {
+        fout << bc.GetMIdx(c) << " " << fc_[c] << " != " << step(x)
+             << std::endl;
+        fassert(false);
+      }
+    }
+  }
+  // piecewise constant field with small noise, sent with and without
+  // error-bounded compression
+  auto noisy = [&](Vect x) -> Scal { return step(x) + 1e-4 * func(x); };
+  if (sem("init-lossy")) {
+    fc_.Reinit(m, 0);
+    fcv_.Reinit(m, Vect(0));
+    for (auto c : m.Cells()) {
+      fc_[c] = noisy(m.GetCenter(c));
+      fcv_[c] = Vect(noisy(m.GetCenter(c)));
+    }
+    m.CommLossy(&fc_);
+    m.Comm(&fcv_);
+  }
+  if (sem("check-lossy")) {
+    const Scal tol = var.Double("native_compress_tol", 0);
+    for (auto c : m.AllCells()) {
+      const auto x = m.GetCenter(c);
+      if (!(std::abs(fc_[c] - noisy(x)) <= tol + 1e-10)) {
+        fout << bc.GetMIdx(c) << " " << fc_[c] << " != " << noisy(x)
+             << std::endl;
+        fassert(false);
+      }
+      if (!Cmp(fcv_[c], Vect(noisy(x)))) {
+        fout << bc.GetMIdx(c) << " " << fcv_[c] << " != " << Vect(noisy(x))
+             << std::endl;
+        fassert(false);
+      }
+    }
+  }
 }
 
 template <class M>
@@ -286,6 +374,31 @@ void Test<M>::TestReduce() {
     PCMP(rsi_.first, s);
     PCMP(indexc.GetMIdx(rsi_.second), ws);
   }
+  if (sem("deferred")) {
+    MIdx w(block_index);
+    r_ = func(w);
+    rsi_ = std::make_pair(func(w), indexc.GetIdx(w));
+    m.ReduceDeferred(&r_, Reduction::sum);
+    m.ReduceDeferred(&rsi_, Reduction::maxloc);
+  }
+  if (sem("deferred-wait")) {
+    m.WaitReduce();
+  }
+  if (sem("deferred-check")) {
+    Scal exact = 0.;
+    Scal s = -std::numeric_limits<Scal>::max();
+    MIdx ws;
+    for (auto w : blocks_all) {
+      exact += func(w);
+      if (func(w) > s) {
+        ws = w;
+        s = func(w);
+      }
+    }
+    PCMP(r_, exact);
+    PCMP(rsi_.first, s);
+    PCMP(indexc.GetMIdx(rsi_.second), ws);
+  }
   if (sem("cat")) {
     MIdx w(block_index);
     rvs_.resize(0);
@@ -510,6 +623,11 @@ void Test<M>::Run() {
   if (sem.Nested()) {
     TestShared();
   }
+  if (sem()) {
+    if (var.Int("imbalance_report", 0)) {
+      m.TimerReport("trep.log");
+    }
+  }
 }
 
 void Main(MPI_Comm comm, Vars& var) {
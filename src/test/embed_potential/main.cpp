@@ -205,8 +205,13 @@ int main(int argc, const char** argv) {
 #if USEFLAG(AMGX)
   FORCE_LINK(linear_amgx);
 #endif
+  FORCE_LINK(linear_bicgstab);
   FORCE_LINK(linear_conjugate);
+  FORCE_LINK(linear_conjugate_pipelined);
+  FORCE_LINK(linear_gmres);
   FORCE_LINK(linear_jacobi);
+  FORCE_LINK(linear_multigrid);
+  FORCE_LINK(linear_precond);
 
   MpiWrapper mpi(&argc, &argv);
   ArgumentParser parser("Solver for the Poisson equation", mpi.IsRoot());
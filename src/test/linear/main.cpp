@@ -30,6 +30,7 @@ void Run(M& m, Vars& var) {
     FieldCell<Scal> fc_diff;
     FieldFace<Scal> ff_rho;
     FieldCell<Expr> fc_system;
+    linear::SystemFaces<M> sys_faces;
     MapEmbed<BCond<Scal>> mebc;
     std::unique_ptr<linear::Solver<M>> solver;
     std::vector<generic::Vect<Scal, 3>> norms;
@@ -99,10 +100,18 @@ void Run(M& m, Vars& var) {
     fassert(factory, "Solver not found: " + name);
     t.solver = factory->Make(var, "symm", m);
     m.flags.linreport = var.Int["VERBOSE"];
+    if (var.Int["faces"]) {
+      t.sys_faces = linear::SystemFaces<M>::FromExpr(t.fc_system, m);
+      FieldCell<Expr>().swap(t.fc_system);
+    }
     t.time_start = t.timer.GetSeconds();
   }
   if (sem.Nested("solve")) {
-    t.info = t.solver->Solve(t.fc_system, &t.fc_sol, t.fc_sol, m);
+    if (var.Int["faces"]) {
+      t.info = t.solver->SolveFaces(t.sys_faces, &t.fc_sol, t.fc_sol, m);
+    } else {
+      t.info = t.solver->Solve(t.fc_system, &t.fc_sol, t.fc_sol, m);
+    }
   }
   if (sem("diff")) {
     t.time_stop = t.timer.GetSeconds();
@@ -151,8 +160,13 @@ int main(int argc, const char** argv) {
 #if USEFLAG(AMGX)
   FORCE_LINK(linear_amgx);
 #endif
+  FORCE_LINK(linear_bicgstab);
   FORCE_LINK(linear_conjugate);
+  FORCE_LINK(linear_conjugate_pipelined);
+  FORCE_LINK(linear_gmres);
   FORCE_LINK(linear_jacobi);
+  FORCE_LINK(linear_multigrid);
+  FORCE_LINK(linear_precond);
 #if USEFLAG(OPENCL)
   FORCE_LINK(linear_conjugate_cl);
 #endif
@@ -176,6 +190,8 @@ int main(int argc, const char** argv) {
   parser.AddVariable<int>("--maxiter", 100).Help("Maximum iterations");
   parser.AddVariable<int>("--mesh", 32).Help("Mesh size in all directions");
   parser.AddVariable<int>("--block", 16).Help("Block size in all directions");
+  parser.AddSwitch("--faces").Help(
+      "Pass the system as symmetric coefficients on faces");
   parser.AddSwitch("--dump").Help(
       "Dump solution, exact solution, and difference");
   parser.AddVariable<std::string>("--system_in", "")
@@ -223,6 +239,7 @@ int main(int argc, const char** argv) {
   conf += "\nset double tol " + args.Double.GetStr("tol");
   conf += "\nset int maxiter " + args.Int.GetStr("maxiter");
   conf += "\nset int dump " + args.Int.GetStr("dump");
+  conf += "\nset int faces " + args.Int.GetStr("faces");
   conf += "\nset string system_in " + args.String.GetStr("system_in");
   conf += "\nset string system_out " + args.String.GetStr("system_out");
   conf += "\nset int VERBOSE " + args.Int.GetStr("verbose");
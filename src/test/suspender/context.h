@@ -54,12 +54,35 @@ void A(Suspender& susp) {
   }
 }
 
+// Context of upper level created after the context of nested level
+void C(Suspender& susp, std::string& out) {
+  Suspender::Sem sem = susp.GetSem();
+  if (sem.Nested()) {
+    B(susp);
+    // nested level is pending after the first call
+    auto* ctx = sem.GetContext<std::vector<int>>();
+    ctx->push_back(1);
+  }
+  if (sem()) {
+    auto* ctx = sem.GetContext<std::vector<int>>();
+    out += ctx->size() == 2 ? "C1" : "fail";
+  }
+}
+
 void Test() {
   Suspender susp;
 
   do {
     A(susp);
   } while (susp.Pending());
+
+  std::string out;
+  for (int i = 0; i < 2; ++i) {
+    do {
+      C(susp, out);
+    } while (susp.Pending());
+  }
+  assert(out == "C1C1");
 }
 
 } // namespace context
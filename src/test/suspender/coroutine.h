@@ -0,0 +1,98 @@
+// Created by Petr Karnakov on 20.03.2021
+// Copyright 2021 ETH Zurich
+
+#include <stdexcept>
+
+namespace coroutine {
+
+using S = Suspender;
+std::string b;
+
+// Coroutine stage inside a loop, followed by a regular stage
+void Run(S& s) {
+  auto e = s.GetSem("C");
+  struct {
+    int k = 0;
+  } * ctx(e);
+  if (e()) {
+    b += "0";
+  }
+  e.LoopBegin();
+  const int k = ctx->k; // captured by value, caller returns after each stage
+  e.Coroutine([k](Coroutine& co) {
+    for (int i = 0; i < 3; ++i) {
+      if (i) {
+        co.Yield();
+      }
+      b += std::to_string(k) + std::to_string(i);
+    }
+  });
+  if (e()) {
+    b += "c";
+    if (++ctx->k == 2) {
+      e.LoopBreak();
+    }
+  }
+  e.LoopEnd();
+  if (e()) {
+    b += "e";
+  }
+}
+
+// Destructor of unfinished coroutine unwinds its stack
+void TestCancel() {
+  int destroyed = 0;
+  struct Guard {
+    int& cnt;
+    ~Guard() {
+      ++cnt;
+    }
+  };
+  {
+    Coroutine co([&destroyed](Coroutine& c) {
+      Guard g{destroyed};
+      c.Yield();
+      c.Yield();
+    });
+    assert(!co.Resume());
+    assert(co.GetYieldCount() == 1);
+    assert(destroyed == 0);
+  }
+  assert(destroyed == 1);
+}
+
+// Exceptions are rethrown from Resume()
+void TestException() {
+  Coroutine co([](Coroutine& c) {
+    c.Yield();
+    throw std::runtime_error("error");
+  });
+  assert(!co.Resume());
+  bool caught = false;
+  try {
+    co.Resume();
+  } catch (const std::runtime_error&) {
+    caught = true;
+  }
+  assert(caught);
+  assert(co.IsDone());
+}
+
+void Test() {
+  S s;
+  b = "";
+  const std::string p = "0|00|01|02|c|10|11|12|c|e|";
+  do {
+    Run(s);
+    b += "|";
+    std::cerr << s.Print() << " " << s.GetNameSequence() << std::endl;
+  } while (s.Pending());
+
+  std::cerr << "'" << b << "' == '" << p << "'" << std::endl;
+  assert(b == p);
+
+  TestCancel();
+  TestException();
+}
+
+} // namespace coroutine
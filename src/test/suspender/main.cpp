@@ -8,6 +8,7 @@
 #include "util/suspender.h"
 
 #include "context.h"
+#include "coroutine.h"
 #include "loop.h"
 #include "other.h"
 #include "simple.h"
@@ -17,4 +18,5 @@ int main() {
   other::Test();
   loop::Test();
   context::Test();
+  coroutine::Test();
 }
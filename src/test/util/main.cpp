@@ -14,9 +14,12 @@
 #include <utility>
 
 #include "debug/isnan.h"
+#include "geom/field.h"
+#include "util/bufferpool.h"
 #include "util/distr.h"
 #include "util/format.h"
 #include "util/height.h"
+#include "util/memtrack.h"
 
 using Scal = double;
 using U = UHeight<Scal>;
@@ -124,8 +127,80 @@ void TestDistr() {
   std::cout << sub.GetConfig() << std::endl;
 }
 
+void TestMemtrack() {
+  std::cout << "\n" << __func__ << std::endl;
+  auto print = []() {
+    for (auto u : memtrack::GetUsage()) {
+      std::cout << util::Format(
+                       "{} current={} peak={} count={}", u.name, u.current,
+                       u.peak, u.count)
+                << std::endl;
+    }
+  };
+  Vector<double> va;
+  {
+    MEMTRACK_SCOPE("a");
+    va.resize(10);
+    Vector<double> tmp(20);
+    {
+      MEMTRACK_SCOPE("b");
+      Vector<char> vb(5);
+      Vector<double> copy(va);
+      va = std::move(copy); // memory of `copy` now owned by `va`
+      print();
+    }
+    memtrack::Account buf;
+    buf.Set(100);
+    print();
+  }
+  print();
+}
+
+void TestBufferPool() {
+  std::cout << "\n" << __func__ << std::endl;
+  auto& pool = BufferPool::GetInstance();
+  pool.SetEnabled(true);
+  auto print = [&pool]() {
+    const auto stat = pool.GetStat();
+    std::cout << util::Format(
+                     "hits={} misses={} cached={} peak_cached={}", stat.hits,
+                     stat.misses, stat.cached, stat.peak_cached)
+              << std::endl;
+  };
+  const double* data;
+  {
+    Vector<double> v(10, 1.);
+    data = v.data();
+    Vector<double> u(20);
+  }
+  print();
+  {
+    Vector<char> u(160);
+    Vector<double> v(10);
+    assert(v.data() == data);
+    print();
+  }
+  pool.SetEnabled(false);
+  print();
+  // buffers beyond the capacity are released
+  pool.SetEnabled(true);
+  pool.SetCapacity(100);
+  { Vector<char> u(160); }
+  print();
+  pool.SetCapacity(size_t(-1));
+  // buffers are reused by the same thread
+  pool.SetPerThread(true);
+  { Vector<double> v(10); }
+  { Vector<double> v(10); }
+  print();
+  pool.SetPerThread(false);
+  pool.SetEnabled(false);
+}
+
 int main() {
   TestGood();
   TestGood2();
   TestDistr();
+  TestMemtrack();
+  TestBufferPool();
 }
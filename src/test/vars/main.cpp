@@ -123,9 +123,39 @@ void TestHook() {
   v.Vect["d"];
 }
 
+void TestHandle() {
+  std::cout << __func__ << std::endl;
+  Vars v(
+      [](const std::string key) { std::cout << "hook: " << key << std::endl; });
+  v.SetStr("int", "a", "1");
+  auto ha = v.Int.GetHandle("a");
+  auto hb = v.Int.GetHandle("b", 2);
+  auto print = [&]() {
+    const int a = *ha;
+    const int b = *hb;
+    std::cout << "a=" << a << " b=" << b << std::endl;
+  };
+  print();
+
+  // value changed, no lookup by key
+  v.SetStr("int", "a", "3");
+  v.Int["a"] = 4;
+  print();
+
+  // variable added, lookup again
+  v.SetStr("int", "b", "5");
+  print();
+
+  // variable deleted, default value
+  v.Int.Del("b");
+  print();
+  assert(!v.Int.GetHandle("b").Find());
+}
+
 int main() {
   simple::Simple();
 
   Test();
   TestHook();
+  TestHandle();
 }
@@ -0,0 +1,173 @@
+// Created by Petr Karnakov on 30.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "memtrack.h"
+
+// Pool of memory buffers reused by Vector and fields.
+// Freed buffers are kept in free lists by their size in bytes, which
+// for fields is determined by the number of cells or faces in a block.
+// The next allocation of the same size takes a buffer from the list
+// instead of calling operator new. Memory of cached buffers is
+// reported to memtrack as owner "pool" and limited by the capacity,
+// buffers freed beyond the capacity are released.
+// If disabled (default), buffers are allocated and freed directly.
+// Shared mode keeps one set of free lists guarded by a mutex.
+// Per-thread mode keeps separate free lists for each thread without locking,
+// so that a buffer stays on the NUMA node of the thread that used it.
+class BufferPool {
+ public:
+  struct Stat {
+    size_t hits = 0; // allocations served from the pool
+    size_t misses = 0; // allocations with operator new
+    size_t cached = 0; // bytes in free buffers
+    size_t peak_cached = 0; // maximum of cached, sum over threads
+  };
+
+  // Single instance shared by all translation units,
+  // never destroyed to allow freeing memory of static objects
+  static BufferPool& GetInstance() {
+    static BufferPool* pool = new BufferPool();
+    return *pool;
+  }
+  // Must be called outside of parallel regions
+  void SetEnabled(bool enabled) {
+    enabled_ = enabled;
+    if (!enabled) {
+      Clear();
+    }
+  }
+  bool IsEnabled() const {
+    return enabled_;
+  }
+  // If true, buffers freed by a thread are only reused by the same thread.
+  // Must be called outside of parallel regions.
+  void SetPerThread(bool perthread) {
+    if (perthread != perthread_) {
+      Clear();
+      perthread_ = perthread;
+    }
+  }
+  // Sets the maximum size of cached buffers in bytes,
+  // applies to each thread in per-thread mode
+  void SetCapacity(size_t bytes) {
+    capacity_ = bytes;
+  }
+  void* Allocate(size_t bytes) {
+    if (enabled_) {
+      if (perthread_) {
+        return Take(GetThreadLists(), bytes);
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      return Take(shared_, bytes);
+    }
+    return ::operator new(bytes);
+  }
+  void Free(void* ptr, size_t bytes) noexcept {
+    if (enabled_) {
+      if (perthread_) {
+        Put(GetThreadLists(), ptr, bytes);
+        return;
+      }
+      std::lock_guard<std::mutex> lock(mutex_);
+      Put(shared_, ptr, bytes);
+      return;
+    }
+    ::operator delete(ptr);
+  }
+  // Releases all cached buffers.
+  // Must be called outside of parallel regions.
+  void Clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Clear(shared_);
+    for (auto& lists : threads_) {
+      Clear(*lists);
+    }
+  }
+  // Must be called outside of parallel regions
+  Stat GetStat() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    Stat res = shared_.stat;
+    for (auto& lists : threads_) {
+      res.hits += lists->stat.hits;
+      res.misses += lists->stat.misses;
+      res.cached += lists->stat.cached;
+      res.peak_cached += lists->stat.peak_cached;
+    }
+    return res;
+  }
+
+ private:
+  // Free lists of one thread or shared by all threads
+  struct Lists {
+    explicit Lists(memtrack::Tag tag) : mem(tag) {}
+    std::unordered_map<size_t, std::vector<void*>> free; // buffers by size
+    Stat stat;
+    memtrack::Account mem; // memory of cached buffers
+  };
+
+  BufferPool() : tag_(memtrack::GetTag("pool")), shared_(tag_) {}
+  void* Take(Lists& lists, size_t bytes) {
+    auto it = lists.free.find(bytes);
+    if (it != lists.free.end() && !it->second.empty()) {
+      void* ptr = it->second.back();
+      it->second.pop_back();
+      ++lists.stat.hits;
+      lists.stat.cached -= bytes;
+      lists.mem.Set(lists.stat.cached);
+      return ptr;
+    }
+    ++lists.stat.misses;
+    return ::operator new(bytes);
+  }
+  void Put(Lists& lists, void* ptr, size_t bytes) noexcept {
+    auto& stat = lists.stat;
+    if (stat.cached + bytes > capacity_) {
+      ::operator delete(ptr);
+      return;
+    }
+    lists.free[bytes].push_back(ptr);
+    stat.cached += bytes;
+    stat.peak_cached = std::max(stat.peak_cached, stat.cached);
+    lists.mem.Set(stat.cached);
+  }
+  static void Clear(Lists& lists) {
+    for (auto& p : lists.free) {
+      for (void* ptr : p.second) {
+        ::operator delete(ptr);
+      }
+    }
+    lists.free.clear();
+    lists.stat.cached = 0;
+    lists.mem.Set(0);
+  }
+  // Returns free lists of the calling thread, created on first call.
+  // Lists are never destroyed, so the pointer stays valid.
+  Lists& GetThreadLists() {
+    thread_local Lists* lists = nullptr;
+    if (!lists) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      threads_.emplace_back(new Lists(tag_));
+      lists = threads_.back().get();
+    }
+    return *lists;
+  }
+
+  const memtrack::Tag tag_;
+  std::atomic<bool> enabled_{false};
+  std::atomic<bool> perthread_{false};
+  std::atomic<size_t> capacity_{size_t(-1)};
+  std::mutex mutex_; // guards shared_ and threads_
+  Lists shared_;
+  std::vector<std::unique_ptr<Lists>> threads_; // lists of each thread
+};
@@ -5,6 +5,7 @@
 
 #include <limits.h>
 #include <cassert>
+#include <cmath>
 
 #include "macros.h"
 #if USEFLAG(FPZIP)
@@ -66,6 +67,79 @@ class PassThrough : public FPCompressor {
   Envelope env_; // compression meta data
 };
 
+// Run-length encoding of floating point values.
+// Encoded data is a sequence of blocks, each starting with a header `k`:
+// k > 0 is followed by k literal values,
+// k < 0 is followed by one value repeated -k times.
+// Values within `tol` from the first value of a run are merged into the run,
+// so the error is bounded by `tol` and tol=0 gives lossless compression.
+// Writes at most `nout` values to `out`.
+// Returns the size of encoded data, or `nout + 1` if it does not fit.
+template <class Scal>
+size_t EncodeRuns(
+    const Scal* data, size_t n, Scal tol, Scal* out, size_t nout) {
+  const size_t kMinRun = 3; // shorter runs are stored as literals
+  size_t iout = 0;
+  size_t literal = nout; // header of current literal block
+  size_t i = 0;
+  while (i < n) {
+    const Scal value = data[i];
+    size_t end = i + 1;
+    while (end < n && std::abs(data[end] - value) <= tol) {
+      ++end;
+    }
+    if (end - i >= kMinRun) {
+      if (iout + 2 > nout) {
+        return nout + 1;
+      }
+      out[iout++] = -Scal(end - i);
+      out[iout++] = value;
+      literal = nout;
+      i = end;
+    } else {
+      if (literal == nout) {
+        if (iout + 1 > nout) {
+          return nout + 1;
+        }
+        literal = iout;
+        out[iout++] = 0;
+      }
+      for (; i < end; ++i) {
+        if (iout + 1 > nout) {
+          return nout + 1;
+        }
+        out[literal] += 1;
+        out[iout++] = data[i];
+      }
+    }
+  }
+  return iout;
+}
+
+// Decodes data encoded by EncodeRuns().
+// Returns the number of values written to `out`.
+template <class Scal>
+size_t DecodeRuns(const Scal* data, size_t n, Scal* out) {
+  size_t iout = 0;
+  size_t i = 0;
+  while (i < n) {
+    const Scal header = data[i++];
+    if (header > 0) {
+      const size_t k = header;
+      for (size_t j = 0; j < k; ++j) {
+        out[iout++] = data[i++];
+      }
+    } else {
+      const size_t k = -header;
+      const Scal value = data[i++];
+      for (size_t j = 0; j < k; ++j) {
+        out[iout++] = value;
+      }
+    }
+  }
+  return iout;
+}
+
 #if USEFLAG(FPZIP)
 // Floating point compressor based on the FPZIP library
 template <typename Scal>
@@ -0,0 +1,124 @@
+// Created by Petr Karnakov on 20.03.2021
+// Copyright 2021 ETH Zurich
+
+#include <ucontext.h>
+#include <cstdint>
+#include <exception>
+#include <stdexcept>
+#include <thread>
+
+#include "util/logger.h"
+
+#include "coroutine.h"
+
+struct Coroutine::Imp {
+  // Exception thrown from Yield() to unwind the stack of a suspended function
+  struct Cancel {};
+
+  Imp(Coroutine* owner, Func func_, size_t stack_size)
+      : owner_(owner), func(func_), own_stack(new char[stack_size]),
+        stack(own_stack.get()) {
+    Init(stack_size);
+  }
+  Imp(Coroutine* owner, Func func_, char* stack_, size_t stack_size)
+      : owner_(owner), func(func_), stack(stack_) {
+    Init(stack_size);
+  }
+  void Init(size_t stack_size) {
+    fassert(getcontext(&callee) == 0, "getcontext() failed");
+    callee.uc_stack.ss_sp = stack;
+    callee.uc_stack.ss_size = stack_size;
+    callee.uc_link = &caller;
+    // makecontext() only passes int arguments, split the pointer into two
+    const auto ptr = reinterpret_cast<uintptr_t>(this);
+    makecontext(
+        &callee, reinterpret_cast<void (*)()>(&Entry), 2,
+        unsigned(ptr & 0xffffffff), unsigned(uint64_t(ptr) >> 32));
+  }
+  static void Entry(unsigned lo, unsigned hi) {
+    auto* imp = reinterpret_cast<Imp*>(uintptr_t(lo) | (uint64_t(hi) << 32));
+    try {
+      imp->func(*imp->owner_);
+    } catch (const Cancel&) {
+    } catch (...) {
+      imp->error = std::current_exception();
+    }
+    imp->done = true;
+    // returns to uc_link, the context saved by the last Resume()
+  }
+  bool Resume() {
+    fassert(!done, "Resume() on finished coroutine");
+    fassert(!running, "Resume() from within coroutine");
+    if (!started) {
+      thread = std::this_thread::get_id();
+    }
+    // Cancelling only unwinds the stack and may happen on any thread
+    fassert(
+        cancel || thread == std::this_thread::get_id(),
+        "Resume() from a thread other than the one that started coroutine");
+    started = true;
+    running = true;
+    fassert(swapcontext(&caller, &callee) == 0, "swapcontext() failed");
+    running = false;
+    if (error) {
+      auto e = error;
+      error = nullptr;
+      std::rethrow_exception(e);
+    }
+    return done;
+  }
+  void Yield() {
+    fassert(running, "Yield() outside of coroutine");
+    ++yields;
+    fassert(swapcontext(&callee, &caller) == 0, "swapcontext() failed");
+    if (cancel) {
+      throw Cancel();
+    }
+  }
+
+  Coroutine* owner_;
+  Func func;
+  std::unique_ptr<char[]> own_stack; // stack allocated by constructor
+  char* stack;
+  std::thread::id thread; // thread of the first Resume()
+  ucontext_t caller; // context of the last Resume()
+  ucontext_t callee; // context of the function
+  bool started = false;
+  bool running = false;
+  bool done = false;
+  bool cancel = false;
+  size_t yields = 0;
+  std::exception_ptr error;
+};
+
+Coroutine::Coroutine(Func func, size_t stack_size)
+    : imp(new Imp(this, func, stack_size)) {}
+
+Coroutine::Coroutine(Func func, char* stack, size_t stack_size)
+    : imp(new Imp(this, func, stack, stack_size)) {}
+
+Coroutine::~Coroutine() {
+  if (imp->started && !imp->done && !imp->running) {
+    imp->cancel = true;
+    try {
+      imp->Resume();
+    } catch (...) {
+    }
+  }
+}
+
+bool Coroutine::Resume() {
+  return imp->Resume();
+}
+
+void Coroutine::Yield() {
+  imp->Yield();
+}
+
+bool Coroutine::IsDone() const {
+  return imp->done;
+}
+
+size_t Coroutine::GetYieldCount() const {
+  return imp->yields;
+}
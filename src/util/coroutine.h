@@ -0,0 +1,45 @@
+// Created by Petr Karnakov on 20.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+// Stackful coroutine.
+// The function passed to the constructor runs on a separate stack
+// and suspends itself by calling Yield(), which returns control to Resume().
+// The next call of Resume() continues the function after Yield().
+// The function must be resumed from the thread that started it,
+// since code compiled for one thread may cache addresses of thread_local
+// variables across Yield().
+class Coroutine {
+ public:
+  using Func = std::function<void(Coroutine&)>;
+  static constexpr size_t kStackSize = 1 << 20;
+  // func: function to execute, called on first Resume()
+  // stack_size: size of stack in bytes
+  explicit Coroutine(Func func, size_t stack_size = kStackSize);
+  // Same as above but runs on memory `stack` of `stack_size` bytes
+  // owned by the caller, which must outlive the coroutine.
+  Coroutine(Func func, char* stack, size_t stack_size);
+  Coroutine(const Coroutine&) = delete;
+  Coroutine& operator=(const Coroutine&) = delete;
+  // Destroys the stack of a suspended function.
+  // Destructors of objects on the stack are called by throwing
+  // an internal exception from Yield().
+  ~Coroutine();
+  // Runs the function until the next Yield() or return.
+  // Rethrows exceptions from the function.
+  // Returns true if the function has returned.
+  bool Resume();
+  // Suspends the function. Must be called from within the function.
+  void Yield();
+  bool IsDone() const;
+  // Returns the number of calls to Yield()
+  size_t GetYieldCount() const;
+
+ private:
+  struct Imp;
+  std::unique_ptr<Imp> imp;
+};
@@ -13,8 +13,13 @@ auto ULinear<M_>::MakeLinearSolver(
 #if USEFLAG(HYPRE)
   FORCE_LINK(linear_hypre);
 #endif
+  FORCE_LINK(linear_bicgstab);
   FORCE_LINK(linear_conjugate);
+  FORCE_LINK(linear_conjugate_pipelined);
+  FORCE_LINK(linear_gmres);
   FORCE_LINK(linear_jacobi);
+  FORCE_LINK(linear_multigrid);
+  FORCE_LINK(linear_precond);
 
   auto addprefix = [prefix](std::string name) {
     return "hypre_" + prefix + "_" + name;
@@ -0,0 +1,189 @@
+// Created by Petr Karnakov on 29.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "macros.h"
+
+// Accounting of memory allocated by Vector (and fields) and other buffers.
+// Each allocation is attributed to an owner tag, the current tag
+// of the calling thread set by Scope. Allocations outside
+// of any scope belong to tag "other".
+// Accounting is enabled by default and can be disabled with SetEnabled(),
+// then allocations get tag kNone and are not accounted.
+namespace memtrack {
+
+// Index of owner in the registry
+using Tag = uint16_t;
+// Tag of allocations that are not accounted
+constexpr Tag kNone = Tag(-1);
+
+struct Usage {
+  std::string name; // owner
+  size_t current; // bytes currently allocated
+  size_t peak; // maximum of current bytes
+  size_t count; // total number of allocations
+};
+
+namespace detail {
+
+struct Entry {
+  std::string name;
+  std::atomic<size_t> current{0};
+  std::atomic<size_t> peak{0};
+  std::atomic<size_t> count{0};
+};
+
+struct Registry {
+  static constexpr size_t kMaxTags = 64;
+  Registry() {
+    entries[0].name = "other";
+    size = 1;
+  }
+  std::array<Entry, kMaxTags> entries;
+  std::atomic<size_t> size;
+  std::atomic<bool> enabled{true};
+  std::mutex mutex; // guards registration of new tags
+};
+
+// Single instance shared by all translation units,
+// never destroyed to allow freeing memory of static objects
+inline Registry& GetRegistry() {
+  static Registry* registry = new Registry();
+  return *registry;
+}
+
+inline Tag& GetCurrent() {
+  thread_local Tag tag = 0;
+  return tag;
+}
+
+} // namespace detail
+
+// Returns tag of owner `name`, registers the owner on first call.
+// Owners beyond the capacity of the registry fall back to "other".
+// Locks the registry, so callers in frequent code should keep the result
+// or use MEMTRACK_SCOPE.
+inline Tag GetTag(const std::string& name) {
+  auto& reg = detail::GetRegistry();
+  std::lock_guard<std::mutex> lock(reg.mutex);
+  const size_t size = reg.size;
+  for (size_t i = 0; i < size; ++i) {
+    if (reg.entries[i].name == name) {
+      return i;
+    }
+  }
+  if (size == detail::Registry::kMaxTags) {
+    return 0;
+  }
+  reg.entries[size].name = name;
+  reg.size = size + 1;
+  return size;
+}
+
+// Enables or disables accounting of new allocations.
+// Allocations made before keep their state until freed.
+inline void SetEnabled(bool enabled) {
+  detail::GetRegistry().enabled.store(enabled, std::memory_order_relaxed);
+}
+
+inline bool IsEnabled() {
+  return detail::GetRegistry().enabled.load(std::memory_order_relaxed);
+}
+
+// Returns the current tag of the calling thread,
+// or kNone if accounting is disabled
+inline Tag GetCurrent() {
+  return IsEnabled() ? detail::GetCurrent() : kNone;
+}
+
+inline void Allocate(Tag tag, size_t bytes) {
+  if (tag == kNone) {
+    return;
+  }
+  auto& e = detail::GetRegistry().entries[tag];
+  const size_t current = (e.current += bytes);
+  ++e.count;
+  size_t peak = e.peak;
+  while (current > peak && !e.peak.compare_exchange_weak(peak, current)) {
+  }
+}
+
+inline void Free(Tag tag, size_t bytes) {
+  if (tag == kNone) {
+    return;
+  }
+  detail::GetRegistry().entries[tag].current -= bytes;
+}
+
+// Returns usage of all registered owners in order of registration
+inline std::vector<Usage> GetUsage() {
+  auto& reg = detail::GetRegistry();
+  std::vector<Usage> res;
+  const size_t size = reg.size;
+  for (size_t i = 0; i < size; ++i) {
+    const auto& e = reg.entries[i];
+    res.push_back({e.name, e.current, e.peak, e.count});
+  }
+  return res;
+}
+
+// Sets the current tag of the calling thread on construction
+// and restores the previous tag on destruction.
+class Scope {
+ public:
+  explicit Scope(Tag tag) : prev_(detail::GetCurrent()) {
+    detail::GetCurrent() = tag;
+  }
+  Scope(const Scope&) = delete;
+  Scope& operator=(const Scope&) = delete;
+  ~Scope() {
+    detail::GetCurrent() = prev_;
+  }
+
+ private:
+  Tag prev_;
+};
+
+// Sets the current tag to owner `name` until the end of the enclosing block.
+// The tag is resolved on the first call at each site.
+#define MEMTRACK_SCOPE(name)                                      \
+  ::memtrack::Scope APHROS_XCAT(memtrack_scope_, __LINE__)([]() { \
+    static const ::memtrack::Tag tag = ::memtrack::GetTag(name);  \
+    return tag;                                                   \
+  }())
+
+// Memory of a buffer not allocated by Vector, e.g. std::vector.
+// The owner is the current tag at construction.
+class Account {
+ public:
+  Account() : tag_(GetCurrent()) {}
+  explicit Account(Tag tag) : tag_(IsEnabled() ? tag : kNone) {}
+  Account(const Account&) = delete;
+  Account& operator=(const Account&) = delete;
+  ~Account() {
+    Set(0);
+  }
+  // Changes the accounted size of the buffer to `bytes`
+  void Set(size_t bytes) {
+    if (bytes > bytes_) {
+      Allocate(tag_, bytes - bytes_);
+    } else {
+      Free(tag_, bytes_ - bytes);
+    }
+    bytes_ = bytes;
+  }
+
+ private:
+  Tag tag_;
+  size_t bytes_ = 0;
+};
+
+} // namespace memtrack
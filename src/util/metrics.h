@@ -13,6 +13,7 @@ class MultiTimer {
  public:
   using Key = Key_;
   using Value = double;
+  using Counters = PerfCounters::Values;
 
   // Marks start of timer with empty key.
   void Push();
@@ -22,20 +23,33 @@ class MultiTimer {
   const std::map<Key, Value>& GetMap() const;
   // Resets all accumulated time to zero
   void Reset();
+  // Enables accumulation of hardware counters passed to AddCounters()
+  void EnableCounters();
+  bool IsCountersEnabled() const {
+    return counters_enabled_;
+  }
+  // Adds counters to the timer started by the last Push(),
+  // accumulated with the key passed to Pop() like time.
+  void AddCounters(const Counters& counters);
+  // Returns map of accumulated counters, empty if not enabled
+  const std::map<Key, Counters>& GetCounters() const;
 
  private:
   SingleTimer timer_;
   struct Start {
     Key key;
     Value time;
+    Counters counters;
   };
   std::map<Key, Value> accum_time_;
+  std::map<Key, Counters> accum_counters_;
   std::stack<Start> starts_;
+  bool counters_enabled_ = false;
 };
 
 template <class Key>
 void MultiTimer<Key>::Push() {
-  starts_.push({{}, timer_.GetSeconds()});
+  starts_.push({{}, timer_.GetSeconds(), {}});
 }
 
 template <class Key>
@@ -43,6 +57,12 @@ void MultiTimer<Key>::Pop(const Key& key) {
   Start& start = starts_.top();
   start.key = key;
   accum_time_[start.key] += timer_.GetSeconds() - start.time;
+  if (counters_enabled_) {
+    auto& accum = accum_counters_[start.key];
+    for (size_t i = 0; i < accum.size(); ++i) {
+      accum[i] += start.counters[i];
+    }
+  }
   starts_.pop();
 }
 
@@ -54,4 +74,23 @@ auto MultiTimer<Key>::GetMap() const -> const std::map<Key, Value>& {
 template <class Key>
 void MultiTimer<Key>::Reset() {
   accum_time_.clear();
+  accum_counters_.clear();
+}
+
+template <class Key>
+void MultiTimer<Key>::EnableCounters() {
+  counters_enabled_ = true;
+}
+
+template <class Key>
+void MultiTimer<Key>::AddCounters(const Counters& counters) {
+  auto& start = starts_.top().counters;
+  for (size_t i = 0; i < start.size(); ++i) {
+    start[i] += counters[i];
+  }
+}
+
+template <class Key>
+auto MultiTimer<Key>::GetCounters() const -> const std::map<Key, Counters>& {
+  return accum_counters_;
 }
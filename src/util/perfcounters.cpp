@@ -0,0 +1,108 @@
+// Created by Petr Karnakov on 28.03.2021
+// Copyright 2021 ETH Zurich
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstring>
+#endif
+
+#include "perfcounters.h"
+
+PerfCounters::PerfCounters() {
+  fd_.fill(-1);
+#ifdef __linux__
+  const std::array<uint64_t, kNumCounters> configs = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_CACHE_MISSES,
+  };
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = configs[i];
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format =
+        PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    // pid=0, cpu=-1: calling thread on any CPU
+    fd_[i] = syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+#endif
+}
+
+PerfCounters::~PerfCounters() {
+#ifdef __linux__
+  for (int fd : fd_) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+#endif
+}
+
+std::string PerfCounters::GetName(size_t i) {
+  switch (i) {
+    case kCycles:
+      return "cycles";
+    case kInstructions:
+      return "instructions";
+    case kCacheMisses:
+      return "llc_misses";
+  }
+  return "";
+}
+
+bool PerfCounters::IsAvailable(size_t i) const {
+  return fd_[i] >= 0;
+}
+
+bool PerfCounters::IsAvailable() const {
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    if (IsAvailable(i)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+auto PerfCounters::Read() const -> Samples {
+  Samples res;
+#ifdef __linux__
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    if (fd_[i] < 0) {
+      continue;
+    }
+    uint64_t buf[3]; // value, time enabled, time running
+    if (read(fd_[i], buf, sizeof(buf)) != sizeof(buf)) {
+      continue;
+    }
+    res[i].value = buf[0];
+    res[i].time_enabled = buf[1];
+    res[i].time_running = buf[2];
+  }
+#endif
+  return res;
+}
+
+auto PerfCounters::GetDelta(const Samples& start, const Samples& stop)
+    -> Values {
+  Values res;
+  for (size_t i = 0; i < kNumCounters; ++i) {
+    // Raw values are monotonic, so the differences are non-negative
+    const uint64_t value = stop[i].value - start[i].value;
+    const uint64_t enabled = stop[i].time_enabled - start[i].time_enabled;
+    const uint64_t running = stop[i].time_running - start[i].time_running;
+    if (running == 0) {
+      res[i] = 0;
+    } else if (running < enabled) { // counter was multiplexed
+      res[i] = uint64_t(double(value) * enabled / running);
+    } else {
+      res[i] = value;
+    }
+  }
+  return res;
+}
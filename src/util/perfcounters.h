@@ -0,0 +1,51 @@
+// Created by Petr Karnakov on 28.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+// Hardware performance counters of the calling thread
+// using perf_event_open(2) on Linux.
+// Counters that cannot be opened are unavailable and read as zero.
+// Reasons include non-Linux systems, restrictions by
+// /proc/sys/kernel/perf_event_paranoid, containers and virtual machines
+// without a PMU. Only events in user space are counted.
+class PerfCounters {
+ public:
+  enum Counter : size_t {
+    kCycles,
+    kInstructions,
+    kCacheMisses, // last level cache
+    kNumCounters,
+  };
+  using Values = std::array<uint64_t, kNumCounters>;
+  // Raw state of a counter
+  struct Sample {
+    uint64_t value = 0;
+    uint64_t time_enabled = 0; // time the counter was enabled [ns]
+    uint64_t time_running = 0; // time the counter was on the PMU [ns]
+  };
+  using Samples = std::array<Sample, kNumCounters>;
+
+  PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+  ~PerfCounters();
+  // Returns short name of counter, e.g. "cycles"
+  static std::string GetName(size_t i);
+  bool IsAvailable(size_t i) const;
+  // Returns true if at least one counter is available
+  bool IsAvailable() const;
+  // Returns current raw values since construction
+  Samples Read() const;
+  // Returns increments of counters from `start` to `stop`,
+  // scaled by the fraction of time the counter was scheduled on the PMU
+  // within the interval. Counters that were not scheduled are zero.
+  static Values GetDelta(const Samples& start, const Samples& stop);
+
+ private:
+  std::array<int, kNumCounters> fd_; // file descriptor or -1
+};
@@ -1,7 +1,9 @@
 // Created by Petr Karnakov on 25.04.2018
 // Copyright 2018 ETH Zurich
 
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
 #include <iomanip>
 #include <sstream>
 #include <stdexcept>
@@ -14,7 +16,7 @@ Suspender::Sem::Sem(Suspender& owner, const std::string& name) : owner_(owner) {
   auto& states = owner_.states_;
   auto& pos = owner_.pos_;
 
-  if (pos == states.begin()) {
+  if (pos == 0) {
     owner_.allow_nested_ = true; // allow nested calls on first level
     owner_.depth_ = 0;
   }
@@ -25,12 +27,14 @@ Suspender::Sem::Sem(Suspender& owner, const std::string& name) : owner_(owner) {
           ": Nested calls not allowed. Use `sem.Nested()` on upper level");
   owner_.allow_nested_ = false;
 
-  if (std::next(pos) == states.end()) {
-    states.emplace_back(0, 0, name);
+  if (pos + 1 == states.size()) {
+    states.emplace_back(
+        0, 0, owner_.Intern(name), owner_.Intern(""), owner_.arena_.GetMark());
   }
   ++pos;
 
-  pos->current = 0;
+  states[pos].current = 0;
+  name_ = states[pos].name;
 }
 
 Suspender::Sem::~Sem() {
@@ -38,28 +42,31 @@ Suspender::Sem::~Sem() {
   auto& pos = owner_.pos_;
 
   assert(!states.empty());
-  assert(pos != states.end());
-  assert(pos != states.begin());
+  assert(pos < states.size());
+  assert(pos != 0);
 
-  auto ip = std::prev(pos);
+  const size_t ip = pos - 1;
 
-  if (std::next(pos) == states.end()) {
+  if (pos + 1 == states.size()) {
     // all lower levels done, next stage
-    ++pos->target;
-    // pos->current keeps total number of stages
-    if (pos->current == pos->target || pos->current == 0) {
+    State& s = states[pos];
+    ++s.target;
+    // s.current keeps total number of stages
+    if (s.current == s.target || s.current == 0) {
       // all stages done or no stages, remove current level
-      states.pop_back();
+      owner_.PopLevel();
     }
   }
   pos = ip;
 }
 
 bool Suspender::Sem::Next(const std::string& suff) {
-  auto& pos = owner_.pos_;
-  if (pos->current++ == pos->target) {
-    pos->suff = suff;
-    pos->suff_id = pos->target;
+  State& s = owner_.states_[owner_.pos_];
+  if (s.current++ == s.target) {
+    if (*s.suff != suff) {
+      s.suff = owner_.Intern(suff);
+    }
+    s.suff_id = s.target;
     ++owner_.depth_;
     return true;
   }
@@ -77,7 +84,7 @@ bool Suspender::Sem::Nested(const std::string& suff) {
 }
 
 void Suspender::Sem::LoopBegin() {
-  State& s = *owner_.pos_;
+  State& s = owner_.states_[owner_.pos_];
   if (s.current == s.target) {
     if (s.loop_begin < s.current) {
       s.loop_begin = s.current;
@@ -88,14 +95,14 @@ void Suspender::Sem::LoopBegin() {
 }
 
 void Suspender::Sem::LoopBreak() {
-  State& s = *owner_.pos_;
+  State& s = owner_.states_[owner_.pos_];
   s.target = s.loop_end; // set target beyond loop end
 }
 
 // Important to initialize loop_end even before target reaches LoopEnd
 // to be able to break on first iteration
 void Suspender::Sem::LoopEnd() {
-  State& s = *owner_.pos_;
+  State& s = owner_.states_[owner_.pos_];
   if (s.loop_end < s.loop_begin && // loop_end not initialized for current loop
       s.loop_begin <= s.target) { // target is within the loop
     s.loop_end = s.current;
@@ -106,9 +113,55 @@ void Suspender::Sem::LoopEnd() {
   ++s.current;
 }
 
-Suspender::Suspender() : allow_nested_(false) {
-  states_.emplace_back(-1, -1, "");
-  pos_ = states_.begin();
+constexpr size_t Suspender::Arena::kChunkSize;
+
+void* Suspender::Arena::Allocate(size_t size, size_t align) {
+  while (true) {
+    if (top_.chunk == chunks_.size()) {
+      const size_t n = std::max(kChunkSize, size + align);
+      chunks_.push_back({std::unique_ptr<char[]>(new char[n]), n});
+    }
+    Chunk& chunk = chunks_[top_.chunk];
+    const auto base = reinterpret_cast<uintptr_t>(chunk.data.get());
+    const size_t offset =
+        (base + top_.offset + align - 1) / align * align - base;
+    if (offset + size <= chunk.size) {
+      top_.offset = offset + size;
+      return chunk.data.get() + offset;
+    }
+    ++top_.chunk;
+    top_.offset = 0;
+  }
+}
+
+Suspender::Suspender() : pos_(0), allow_nested_(false), depth_(0) {
+  states_.emplace_back(-1, -1, Intern(""), Intern(""), arena_.GetMark());
+}
+
+Suspender::~Suspender() {
+  while (!states_.empty()) {
+    PopLevel();
+  }
+}
+
+void Suspender::PopLevel() {
+  State& s = states_.back();
+  s.coroutine.reset();
+  if (s.context.ptr) {
+    s.context.destroy(s.context.ptr);
+  }
+  arena_.Reset(s.mark);
+  states_.pop_back();
+}
+
+void Suspender::CheckContextType(const State& state, const void* type) const {
+  fassert(
+      state.context.type == type,
+      GetNameSequence() + ": GetContext() with type different from context");
+}
+
+const std::string* Suspender::Intern(const std::string& name) {
+  return &*names_.insert(name).first;
 }
 
 Suspender::Sem Suspender::GetSem(const std::string& name) {
@@ -127,7 +180,17 @@ std::string Suspender::GetNameSequence() const {
     const int cnt = s.suff_id;
     const char c0 = '0' + cnt % 10;
     const char c1 = '0' + (cnt / 10) % 10;
-    res += s.name + ":" + c1 + c0 + ":" + s.suff;
+    res += *s.name + ":" + c1 + c0 + ":" + *s.suff;
+  }
+  return res;
+}
+
+size_t Suspender::GetYieldCount() const {
+  size_t res = 0;
+  for (const auto& s : states_) {
+    if (s.coroutine) {
+      res += s.coroutine->GetYieldCount();
+    }
   }
   return res;
 }
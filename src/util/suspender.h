@@ -3,9 +3,14 @@
 
 #pragma once
 
-#include <list>
 #include <memory>
+#include <new>
 #include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "coroutine.h"
 
 // TODO: Sequence like
 //   GetSem();
@@ -38,19 +43,49 @@ class Suspender {
     // Next() with nested calls
     bool Nested(const std::string& suff = "");
     const std::string& GetName() const {
-      return name_;
+      return *name_;
     }
     void LoopBegin();
     void LoopBreak();
     void LoopEnd();
+    // Stage executing `func` as a coroutine, alternative to a sequence
+    // of stages. Each call of Coroutine::Yield() ends the current stage,
+    // and the function continues from the same point in the next stage.
+    // The function is called once, so it must capture by value
+    // the local variables of the caller. It cannot call functions with stages.
+    // func: callable with signature `void(Coroutine&)`
+    template <class F>
+    void Coroutine(F func, const std::string& suff = "") {
+      owner_.allow_nested_ = false;
+      if (!Next(suff)) {
+        return;
+      }
+      State& state = owner_.states_[owner_.pos_];
+      if (!state.coroutine) {
+        // At most one coroutine exists at a time since coroutine stages
+        // cannot have nested calls, so all share one stack
+        if (!owner_.coroutine_stack_) {
+          owner_.coroutine_stack_.reset(new char[::Coroutine::kStackSize]);
+        }
+        state.coroutine = std::make_unique<::Coroutine>(
+            func, owner_.coroutine_stack_.get(), ::Coroutine::kStackSize);
+      }
+      if (state.coroutine->Resume()) {
+        state.coroutine.reset();
+      } else {
+        --state.target; // repeat the stage, compensates increment in ~Sem()
+      }
+    }
+    // Returns context of current function, created on first call.
+    // The context is destroyed once all stages of the function are done.
     template <class T>
     T* GetContext() {
-      State& state = *owner_.pos_;
-      std::unique_ptr<BaseHolder>& holder = state.context;
-      if (!holder) {
-        holder = std::make_unique<Holder<T>>(new T());
+      State& state = owner_.states_[owner_.pos_];
+      if (!state.context.ptr) {
+        owner_.CreateContext<T>(state);
       }
-      return dynamic_cast<Holder<T>*>(holder.get())->Get();
+      owner_.CheckContextType(state, GetTypeId<T>());
+      return static_cast<T*>(state.context.ptr);
     }
     template <class T>
     T* GetContext(T*) {
@@ -63,16 +98,22 @@ class Suspender {
 
    private:
     Suspender& owner_;
-    std::string name_;
+    const std::string* name_; // interned name
     // Returns true if current stage needs execution and advances stage counter
     bool Next(const std::string& suff = "");
   };
   friend Sem;
   // Intializes list with auxiliary counter (-1,-1), sets iterator to it
   Suspender();
+  Suspender(Suspender&&) = default;
+  Suspender& operator=(Suspender&&) = default;
+  ~Suspender();
   Sem GetSem(const std::string& name = "");
-  // Returns name+suff of current stage
+  // Returns name+suff of current stage,
+  // same for all yields of a coroutine stage
   std::string GetNameSequence() const;
+  // Returns total number of yields of active coroutine stages
+  size_t GetYieldCount() const;
   // Converts counter list to string
   size_t GetDepth() const {
     return depth_;
@@ -82,36 +123,98 @@ class Suspender {
   bool Pending() const;
 
  private:
-  class BaseHolder {
+  // Stack allocator for contexts.
+  // Memory is kept after Reset() and reused by later levels.
+  class Arena {
    public:
-    virtual ~BaseHolder() = default;
-  };
-  // Container for user-defined context object
-  template <class T>
-  class Holder : public BaseHolder {
-   public:
-    Holder(T* raw) : ptr_(raw) {}
-    T* Get() {
-      return ptr_.get();
+    struct Mark {
+      size_t chunk = 0;
+      size_t offset = 0;
+    };
+    void* Allocate(size_t size, size_t align);
+    Mark GetMark() const {
+      return top_;
+    }
+    // Releases memory allocated after mark `m`
+    void Reset(Mark m) {
+      top_ = m;
     }
 
    private:
-    std::unique_ptr<T> ptr_;
+    static constexpr size_t kChunkSize = 4096;
+    struct Chunk {
+      std::unique_ptr<char[]> data;
+      size_t size;
+    };
+    std::vector<Chunk> chunks_;
+    Mark top_;
+  };
+  // User-defined context object
+  struct Context {
+    void* ptr = nullptr;
+    const void* type = nullptr; // type identifier from GetTypeId()
+    void (*destroy)(void*) = nullptr;
   };
   struct State { // state of a suspended function
     int current; // current stage index
     int target; // target stage index
-    std::string name; // name of function passed to sem()
-    std::string suff;
+    const std::string* name; // interned name of function passed to sem()
+    const std::string* suff; // interned suffix of current stage
     int suff_id = 0;
     int loop_begin = -1; // index of stage with LoopBegin
     int loop_end = -1; // index of stage with LoopEnd
-    std::unique_ptr<BaseHolder> context;
-    State(int current_, int target_, const std::string& name_)
-        : current(current_), target(target_), name(name_) {}
+    Context context;
+    Arena::Mark mark; // arena position before allocating the context
+    std::unique_ptr<::Coroutine> coroutine; // coroutine of current stage
+    State(
+        int current_, int target_, const std::string* name_,
+        const std::string* suff_, Arena::Mark mark_)
+        : current(current_), target(target_), name(name_), suff(suff_),
+          mark(mark_) {}
   };
-  std::list<State> states_; // states of all suspended functions in nested call
-  std::list<State>::iterator pos_; // current function
+  // Returns unique address for each type, replaces RTTI
+  template <class T>
+  static const void* GetTypeId() {
+    static const char id = 0;
+    return &id;
+  }
+  template <class T>
+  static void DestroyContext(void* ptr) {
+    static_cast<T*>(ptr)->~T();
+  }
+  template <class T>
+  static void DeleteContext(void* ptr) {
+    delete static_cast<T*>(ptr);
+  }
+  // Creates context for `state`. Contexts are allocated in the arena
+  // unless they are requested by a function with pending nested calls.
+  template <class T>
+  void CreateContext(State& state) {
+    Context& ctx = state.context;
+    if (pos_ + 1 == states_.size()) {
+      ctx.ptr = new (arena_.Allocate(sizeof(T), alignof(T))) T();
+      ctx.destroy = &DestroyContext<T>;
+    } else {
+      ctx.ptr = new T();
+      ctx.destroy = &DeleteContext<T>;
+    }
+    ctx.type = GetTypeId<T>();
+  }
+  void CheckContextType(const State& state, const void* type) const;
+  // Removes the last level and releases its context
+  void PopLevel();
+  // Returns pointer to a unique copy of `name`
+  const std::string* Intern(const std::string& name);
+
+  // Stack reused by all coroutine stages, declared before states_
+  // to outlive the coroutines
+  std::unique_ptr<char[]> coroutine_stack_;
+  // States of all suspended functions in nested call.
+  // Elements are reused after the vector shrinks, avoiding allocation.
+  std::vector<State> states_;
+  size_t pos_; // index of current function in states_
   bool allow_nested_;
   size_t depth_;
+  Arena arena_;
+  std::unordered_set<std::string> names_; // interned names
 };
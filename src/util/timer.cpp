@@ -17,6 +17,8 @@ std::string ExecutionTimer::GetName() const {
 auto ExecutionTimer::Run() -> Result {
   using Clock = std::chrono::steady_clock;
   Clock clock;
+  PerfCounters perf;
+  const auto startcounters = perf.Read();
   auto startall = clock.now();
   double total_time = 0;
   double min_batch_time = std::numeric_limits<double>::max();
@@ -30,8 +32,15 @@ auto ExecutionTimer::Run() -> Result {
     min_batch_time = std::min(
         min_batch_time, std::chrono::duration<double>(stop - start).count());
   } while (total_time < timeout_);
+  const auto counters = PerfCounters::GetDelta(startcounters, perf.Read());
 
-  return {min_batch_time / batch_, iter};
+  Result res;
+  res.min_call_time = min_batch_time / batch_;
+  res.iters = iter;
+  for (size_t i = 0; i < res.counters.size(); ++i) {
+    res.counters[i] = perf.IsAvailable(i) ? double(counters[i]) / iter : -1;
+  }
+  return res;
 }
 
 void ExecutionTimer::Batch() {
@@ -7,6 +7,8 @@
 #include <string>
 #include <utility>
 
+#include "perfcounters.h"
+
 class ExecutionTimer {
  public:
   // name: returned by GetName()
@@ -17,10 +19,13 @@ class ExecutionTimer {
   virtual ~ExecutionTimer() = default;
   std::string GetName() const;
   // Repeats batches of  F() until reaching the timeout.
-  // Returns minimal execution time per call and number of calls.
+  // Returns minimal execution time per call, number of calls
+  // and hardware counters per call averaged over all calls.
   struct Result {
     double min_call_time;
     size_t iters;
+    // values of PerfCounters per call, negative if unavailable
+    std::array<double, PerfCounters::kNumCounters> counters;
   };
   Result Run();
   // Function to evaluate.
@@ -0,0 +1,152 @@
+// Created by Petr Karnakov on 31.03.2021
+// Copyright 2021 ETH Zurich
+
+#ifdef __linux__
+#include <dirent.h>
+#include <sched.h>
+#endif
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <tuple>
+
+#include "topology.h"
+
+namespace topology {
+
+namespace {
+
+// Parses list of CPUs in format "0-3,8,10-11"
+std::vector<int> ParseList(const std::string& str) {
+  std::vector<int> res;
+  std::stringstream ss(str);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") {
+      continue;
+    }
+    const size_t dash = range.find('-');
+    const int first = std::atoi(range.substr(0, dash).c_str());
+    const int last = (dash == std::string::npos)
+                         ? first
+                         : std::atoi(range.substr(dash + 1).c_str());
+    for (int c = first; c <= last; ++c) {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+// Returns the first line of file or empty string if not readable
+std::string ReadLine(const std::string& path) {
+  std::ifstream f(path);
+  std::string res;
+  std::getline(f, res);
+  return res;
+}
+
+std::string GetCpuDir(int id) {
+  return "/sys/devices/system/cpu/cpu" + std::to_string(id);
+}
+
+} // namespace
+
+std::vector<int> GetOnlineCpus() {
+  auto res = ParseList(ReadLine("/sys/devices/system/cpu/online"));
+  if (res.empty()) {
+    const long n = sysconf(_SC_NPROCESSORS_ONLN);
+    for (int c = 0; c < std::max(1L, n); ++c) {
+      res.push_back(c);
+    }
+  }
+  return res;
+}
+
+std::vector<int> GetAllowedCpus() {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    std::vector<int> res;
+    for (int c = 0; c < CPU_SETSIZE; ++c) {
+      if (CPU_ISSET(c, &set)) {
+        res.push_back(c);
+      }
+    }
+    return res;
+  }
+#endif
+  return GetOnlineCpus();
+}
+
+Cpu GetCpu(int id) {
+  Cpu cpu;
+  cpu.id = id;
+  cpu.core = id;
+  const std::string dir = GetCpuDir(id);
+  const std::string core = ReadLine(dir + "/topology/core_id");
+  if (core.empty()) {
+    return cpu;
+  }
+  cpu.core = std::atoi(core.c_str());
+  cpu.socket =
+      std::atoi(ReadLine(dir + "/topology/physical_package_id").c_str());
+  const auto siblings =
+      ParseList(ReadLine(dir + "/topology/thread_siblings_list"));
+  cpu.thread =
+      std::find(siblings.begin(), siblings.end(), id) - siblings.begin();
+  if (size_t(cpu.thread) == siblings.size()) {
+    cpu.thread = 0;
+  }
+#ifdef __linux__
+  // NUMA node is given by entry "nodeK" in the directory of the CPU
+  if (DIR* d = opendir(dir.c_str())) {
+    while (dirent* e = readdir(d)) {
+      const std::string name = e->d_name;
+      if (name.size() > 4 && name.compare(0, 4, "node") == 0 &&
+          std::isdigit(name[4])) {
+        cpu.node = std::atoi(name.c_str() + 4);
+        break;
+      }
+    }
+    closedir(d);
+  }
+#endif
+  return cpu;
+}
+
+std::vector<int> SelectCompact(
+    const std::vector<int>& allowed, int nthreads, int local_rank,
+    int local_size) {
+  std::vector<Cpu> cpus;
+  for (int id : allowed) {
+    cpus.push_back(GetCpu(id));
+  }
+  const size_t nwant = size_t(nthreads) * local_size;
+  // Use only the first hardware thread of each core if there are enough
+  const size_t ncores = std::count_if(
+      cpus.begin(), cpus.end(), [](const Cpu& c) { return c.thread == 0; });
+  const bool primary = (ncores >= nwant);
+  std::stable_sort(cpus.begin(), cpus.end(), [&](const Cpu& a, const Cpu& b) {
+    const int ta = primary ? a.thread : 0;
+    const int tb = primary ? b.thread : 0;
+    return std::make_tuple(ta, a.node, a.socket, a.core, a.thread) <
+           std::make_tuple(tb, b.node, b.socket, b.core, b.thread);
+  });
+  std::vector<int> res;
+  if (cpus.empty()) {
+    return res;
+  }
+  for (int t = 0; t < nthreads; ++t) {
+    const size_t i = size_t(local_rank) * nthreads + t;
+    res.push_back(cpus[i % cpus.size()].id);
+  }
+  return res;
+}
+
+} // namespace topology
@@ -0,0 +1,38 @@
+// Created by Petr Karnakov on 31.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <vector>
+
+// Topology of CPUs on Linux from /sys/devices/system/cpu.
+// On other systems or if sysfs is not available,
+// each CPU is assumed to be a separate core on socket 0 and node 0.
+namespace topology {
+
+struct Cpu {
+  int id = 0; // logical CPU as in sched_getcpu()
+  int core = 0; // physical core within socket
+  int socket = 0; // physical package
+  int node = 0; // NUMA node
+  int thread = 0; // index among hardware threads of the same core
+};
+
+// Returns online CPUs
+std::vector<int> GetOnlineCpus();
+// Returns CPUs in the affinity mask of the calling thread
+std::vector<int> GetAllowedCpus();
+// Returns topology of CPU `id`
+Cpu GetCpu(int id);
+// Returns CPUs for threads of one rank in compact order:
+// threads of the same rank get neighboring cores on the same socket
+// and one hardware thread per core while there are enough cores.
+// allowed: CPUs available to all ranks
+// nthreads: number of threads per rank
+// local_rank, local_size: rank and number of ranks sharing `allowed`
+// Returns `nthreads` CPUs, repeated cyclically if there are not enough.
+std::vector<int> SelectCompact(
+    const std::vector<int>& allowed, int nthreads, int local_rank,
+    int local_size);
+
+} // namespace topology
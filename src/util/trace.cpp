@@ -0,0 +1,130 @@
+// Created by Petr Karnakov on 25.03.2021
+// Copyright 2021 ETH Zurich
+
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+#include "util/logger.h"
+
+#include "trace.h"
+
+EventTrace::EventTrace(int pid, int nthreads, size_t max_events)
+    : pid_(pid)
+    , max_events_(max_events)
+    , start_(std::chrono::steady_clock::now())
+    , threads_(nthreads)
+    , stage_begin_(0) {}
+
+double EventTrace::GetTime() const {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now() - start_)
+      .count();
+}
+
+void EventTrace::Begin(const char* name, int tid) {
+  fassert(tid >= 0 && size_t(tid) < threads_.size());
+  threads_[tid].stack.push_back({name, GetTime(), 0});
+}
+
+void EventTrace::End(int tid) {
+  const double time = GetTime();
+  auto& th = threads_[tid];
+  fassert(!th.stack.empty(), "End() without Begin()");
+  const Open open = th.stack.back();
+  const double duration = time - open.begin;
+  std::string path;
+  for (const auto& o : th.stack) {
+    path += (path.empty() ? "" : ";");
+    path += o.name;
+  }
+  th.folded[path] += duration - open.nested;
+  th.stack.pop_back();
+  if (th.stack.empty()) {
+    th.outer += duration;
+  } else {
+    th.stack.back().nested += duration;
+  }
+  th.events.push_back({open.name, open.begin, time, tid, -1});
+}
+
+void EventTrace::EndStage(const std::string& name) {
+  const double time = GetTime();
+  const bool store = stages_.size() + events_.size() < max_events_;
+  const int stage = stages_.size();
+  if (store) {
+    stages_.push_back({name, stage_begin_, time});
+  }
+
+  // Components separated by ';' as expected by flamegraph.pl
+  std::string prefix;
+  const std::string sep = " --> ";
+  for (size_t pos = 0;;) {
+    const size_t next = name.find(sep, pos);
+    prefix += name.substr(pos, next - pos);
+    if (next == std::string::npos) {
+      break;
+    }
+    prefix += ';';
+    pos = next + sep.size();
+  }
+
+  // Time of the stage not covered by events on the main thread
+  folded_[prefix] += time - stage_begin_ - threads_[0].outer;
+  for (auto& th : threads_) {
+    for (auto& p : th.folded) {
+      folded_[prefix + ";" + p.first] += p.second;
+    }
+    if (store) {
+      for (auto& e : th.events) {
+        e.stage = stage;
+        events_.push_back(e);
+      }
+    }
+    th.folded.clear();
+    th.events.clear();
+    th.outer = 0;
+  }
+  stage_begin_ = time;
+}
+
+static std::string EscapeJson(const std::string& s) {
+  std::string res;
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      res += '\\';
+    }
+    res += c;
+  }
+  return res;
+}
+
+void EventTrace::WriteChrome(std::ostream& out) const {
+  const auto flags = out.flags();
+  out << std::fixed << std::setprecision(3);
+  out << "{\"traceEvents\":[\n";
+  out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":" << pid_
+      << ",\"args\":{\"name\":\"rank " << pid_ << "\"}}";
+  // Stages on the main thread, other events nested in them
+  for (const auto& s : stages_) {
+    out << ",\n{\"name\":\"" << EscapeJson(s.name) << "\",\"cat\":\"stage\""
+        << ",\"ph\":\"X\",\"ts\":" << s.begin * 1e6
+        << ",\"dur\":" << (s.end - s.begin) * 1e6 << ",\"pid\":" << pid_
+        << ",\"tid\":0}";
+  }
+  for (const auto& e : events_) {
+    out << ",\n{\"name\":\"" << EscapeJson(e.name) << "\",\"cat\":\"event\""
+        << ",\"ph\":\"X\",\"ts\":" << e.begin * 1e6
+        << ",\"dur\":" << (e.end - e.begin) * 1e6 << ",\"pid\":" << pid_
+        << ",\"tid\":" << e.tid << ",\"args\":{\"stage\":\""
+        << EscapeJson(stages_[e.stage].name) << "\"}}";
+  }
+  out << "\n]}\n";
+  out.flags(flags);
+}
+
+void EventTrace::WriteFolded(std::ostream& out) const {
+  for (const auto& p : folded_) {
+    out << p.first << ' ' << size_t(p.second * 1e6) << '\n';
+  }
+}
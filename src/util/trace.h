@@ -0,0 +1,101 @@
+// Created by Petr Karnakov on 25.03.2021
+// Copyright 2021 ETH Zurich
+
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <map>
+#include <string>
+#include <vector>
+
+// Timeline of events on each thread for export
+// in Chrome trace_event format (chrome://tracing, Perfetto)
+// and as folded stacks for flamegraph.pl.
+// Events on one thread must be nested. Different threads
+// record events concurrently without synchronization.
+class EventTrace {
+ public:
+  // pid: process identifier in output, e.g. MPI rank
+  // nthreads: maximum number of threads
+  // max_events: maximum number of events and stages stored
+  //   for WriteChrome(), folded stacks include all events
+  EventTrace(int pid, int nthreads, size_t max_events = 1000000);
+  // Opens event `name` on thread `tid`.
+  // name: string literal, must outlive the object
+  void Begin(const char* name, int tid);
+  // Closes the last open event on thread `tid`
+  void End(int tid);
+  // Closes the current stage. Events closed since the previous call
+  // belong to stage `name`, its components separated by " --> "
+  // as returned by Suspender::GetNameSequence().
+  // Must be called outside of parallel regions.
+  void EndStage(const std::string& name);
+  void WriteChrome(std::ostream& out) const;
+  // Writes lines "stage;...;event time", time is in microseconds
+  // excluding nested events and summed over threads.
+  void WriteFolded(std::ostream& out) const;
+
+  // Opens event on construction and closes on destruction.
+  // Does nothing if `trace` is null.
+  class Scope {
+   public:
+    Scope(EventTrace* trace, const char* name, int tid)
+        : trace_(trace), tid_(tid) {
+      if (trace_) {
+        trace_->Begin(name, tid_);
+      }
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+    Scope(Scope&& o) : trace_(o.trace_), tid_(o.tid_) {
+      o.trace_ = nullptr;
+    }
+    ~Scope() {
+      if (trace_) {
+        trace_->End(tid_);
+      }
+    }
+
+   private:
+    EventTrace* trace_;
+    int tid_;
+  };
+
+ private:
+  struct Event {
+    const char* name;
+    double begin; // time in seconds
+    double end;
+    int tid; // thread
+    int stage; // index in stages_
+  };
+  struct Open { // event in progress
+    const char* name;
+    double begin;
+    double nested; // total time of closed nested events
+  };
+  struct Thread {
+    std::vector<Open> stack;
+    std::vector<Event> events; // events closed in current stage
+    // time excluding nested events in current stage,
+    // key is the path of events separated by ';'
+    std::map<std::string, double> folded;
+    double outer = 0; // total time of outermost events in current stage
+  };
+  double GetTime() const;
+
+  const int pid_;
+  const size_t max_events_;
+  const std::chrono::steady_clock::time_point start_;
+  std::vector<Thread> threads_;
+  std::vector<Event> events_; // events for WriteChrome()
+  struct Stage {
+    std::string name;
+    double begin;
+    double end;
+  };
+  std::vector<Stage> stages_;
+  double stage_begin_; // time of the previous EndStage()
+  std::map<std::string, double> folded_; // time for each path of events
+};